@@ -16,6 +16,7 @@
 #include <sstream>
 #include <stack>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -28,10 +29,60 @@ enum class ERel {
 };
 #endif /* __PROGTEST__ */
 
+/**
+ * @brief Sorted index of all the names (current and previous) of the persons of a register,
+ * the persons with a name starting with a prefix form one range of it. The IDs of each name are sorted.
+ */
+class CNameIndex {
+   private:
+    map<string, vector<int>> m_Names;
+
+   public:
+    void Insert(const string &name, int id) {
+        vector<int> &ids = m_Names[name];
+        auto it = lower_bound(ids.begin(), ids.end(), id);
+        if (it == ids.end() || *it != id) {
+            ids.insert(it, id);
+        }
+    }
+
+    // sorted IDs without duplicates, O(log n + m + k log m) for m matching names with k IDs together
+    vector<int> Find(const string &prefix) const {
+        using TRange = pair<vector<int>::const_iterator, vector<int>::const_iterator>;
+        vector<TRange> heads;
+        for (auto it = m_Names.lower_bound(prefix); it != m_Names.end() && it->first.compare(0, prefix.length(), prefix) == 0; ++it) {
+            heads.push_back({it->second.begin(), it->second.end()});
+        }
+        if (heads.size() == 1) {
+            return vector<int>(heads[0].first, heads[0].second);
+        }
+
+        // merges the sorted lists of the names, the list with the smallest next ID is on top of the heap
+        auto later = [](const TRange &a, const TRange &b) { return *a.first > *b.first; };
+        vector<int> result;
+        make_heap(heads.begin(), heads.end(), later);
+        while (!heads.empty()) {
+            pop_heap(heads.begin(), heads.end(), later);
+            TRange &range = heads.back();
+            if (result.empty() || result.back() != *range.first) {
+                result.push_back(*range.first);
+            }
+            if (++range.first == range.second) {
+                heads.pop_back();
+            } else {
+                push_heap(heads.begin(), heads.end(), later);
+            }
+        }
+        return result;
+    }
+};
+
 class CPerson {
    private:
     string m_Type;
     int m_Id;
+    // indexes of the registers the person was added to, they learn about new names from _nameAdded
+    vector<weak_ptr<CNameIndex>> m_NameIndexes;
 
    protected:
     string m_Name;
@@ -42,16 +93,27 @@ class CPerson {
     CPerson(int id, const string &name, const string &type) : m_Type(type), m_Id(id), m_Name(name) {}
     virtual ~CPerson() = default;
 
-    virtual bool prefixMatched(const string &prefix) const {
-        if (prefix.length() > m_Name.length()) {
-            return false;
+    int GetID() const { return m_Id; }
+    const string &Type() const { return m_Type; }
+
+    // all the names the person can be found by
+    virtual vector<string> Names() const {
+        return {m_Name};
+    }
+
+    void AddNameIndex(const shared_ptr<CNameIndex> &index) {
+        FollowNameIndex(index);
+        for (const auto &it : Names()) {
+            index->Insert(it, m_Id);
         }
-        // return m_Name.rfind(prefix, 0) == 0;
-        return m_Name.find(prefix) == 0;
     }
 
-    int GetID() const { return m_Id; }
-    const string &Type() const { return m_Type; }
+    // the index knows the names already (it is a copy of one the person is in), it only needs the new ones
+    void FollowNameIndex(const shared_ptr<CNameIndex> &index) {
+        m_NameIndexes.erase(remove_if(m_NameIndexes.begin(), m_NameIndexes.end(), [](const weak_ptr<CNameIndex> &it) { return it.expired(); }),
+                            m_NameIndexes.end());
+        m_NameIndexes.push_back(index);
+    }
 
     virtual ostream &Print(ostream &os) const {
         os << m_Id << ": " << m_Name;
@@ -86,6 +148,19 @@ class CPerson {
     friend ostream &operator<<(ostream &os, const CPerson &p) {
         return p.Print(os);
     }
+
+   protected:
+    // the current name has changed, the previous ones stay searchable
+    void _nameAdded() {
+        for (auto it = m_NameIndexes.begin(); it != m_NameIndexes.end();) {
+            if (shared_ptr<CNameIndex> index = it->lock()) {
+                index->Insert(m_Name, m_Id);
+                ++it;
+            } else {
+                it = m_NameIndexes.erase(it);
+            }
+        }
+    }
 };
 
 class CMan : public CPerson {
@@ -111,24 +186,16 @@ class CWoman : public CPerson {
     CWoman() = delete;
     CWoman(int id, const string &name) : CPerson(id, name, "Woman") {}
 
-    bool prefixMatched(const string &prefix) const override {
-        if (CPerson::prefixMatched(prefix)) {
-            return true;
-        }
-        for (const auto &it : m_PreviousNames) {
-            // if ((prefix.length() <= it.length()) && it.rfind(prefix, 0) == 0) {
-            //     return true;
-            // }
-            if ((prefix.length() <= it.length()) && it.find(prefix) == 0) {
-                return true;
-            }
-        }
-        return false;
+    vector<string> Names() const override {
+        vector<string> names = m_PreviousNames;
+        names.push_back(m_Name);
+        return names;
     }
 
     void Wedding(const string &newName) {
         m_PreviousNames.push_back(m_Name);
         m_Name = newName;
+        _nameAdded();
     }
 
     ostream &Print(ostream &os) const override {
@@ -154,6 +221,165 @@ class CWoman : public CPerson {
     }
 };
 
+/**
+ * @brief Family links of a register over dense person indexes given in the order of adding. Parents
+ * are columns, the children of each person are appended to its list as they are added.
+ */
+class CFamilyGraph {
+   public:
+    static constexpr int NONE = -1;
+
+   private:
+    vector<int> m_Ids;
+    vector<char> m_Men;
+    vector<int> m_Fathers;
+    vector<int> m_Mothers;
+    vector<vector<int>> m_Children;
+
+   public:
+    int Add(int id, bool man, int father, int mother) {
+        int index = int(m_Ids.size());
+        m_Ids.push_back(id);
+        m_Men.push_back(man);
+        m_Fathers.push_back(father);
+        m_Mothers.push_back(mother);
+        m_Children.emplace_back();
+        for (int parent : {father, mother}) {
+            if (parent != NONE) {
+                m_Children[parent].push_back(index);
+            }
+        }
+        return index;
+    }
+
+    size_t Size() const { return m_Ids.size(); }
+    int ID(int index) const { return m_Ids[index]; }
+    bool Man(int index) const { return m_Men[index]; }
+    int Father(int index) const { return m_Fathers[index]; }
+    int Mother(int index) const { return m_Mothers[index]; }
+
+    // relatives one step away in the order the searches prefer them: father, mother, children as added
+    template <typename TFn>
+    void ForEachRelative(int index, TFn &&fn) const {
+        if (m_Fathers[index] != NONE) {
+            fn(m_Fathers[index], ERel::REL_FATHER);
+        }
+        if (m_Mothers[index] != NONE) {
+            fn(m_Mothers[index], ERel::REL_MOTHER);
+        }
+        for (int child : m_Children[index]) {
+            fn(child, m_Men[child] ? ERel::REL_SON : ERel::REL_DAUGHTER);
+        }
+    }
+};
+
+/**
+ * @brief Close ancestors of every person of a family graph (up to MAX_GENERATIONS back, at most 30 of them),
+ * sorted by index. A person never gets new ancestors once added, so the lists are built once, from the lists
+ * of the parents. Farther relations are left to the graph search.
+ */
+class CAncestorIndex {
+   public:
+    static constexpr int MAX_GENERATIONS = 4;
+
+   private:
+    struct CAncestor {
+        int index;
+        int generations;
+    };
+    vector<vector<CAncestor>> m_Ancestors;
+
+    const CAncestor *_find(int index, int ancestor) const {
+        const vector<CAncestor> &list = m_Ancestors[index];
+        auto found = lower_bound(list.begin(), list.end(), ancestor, [](const CAncestor &a, int b) { return a.index < b; });
+        return found != list.end() && found->index == ancestor ? &*found : nullptr;
+    }
+
+   public:
+    // the person at index is the latest one added to graph
+    void Add(const CFamilyGraph &graph, int index) {
+        vector<CAncestor> ancestors;
+        for (int parent : {graph.Father(index), graph.Mother(index)}) {
+            if (parent == CFamilyGraph::NONE) {
+                continue;
+            }
+            vector<CAncestor> line{{parent, 1}};
+            for (const CAncestor &it : m_Ancestors[parent]) {
+                if (it.generations < MAX_GENERATIONS) {
+                    line.push_back({it.index, it.generations + 1});
+                }
+            }
+            sort(line.begin(), line.end(), [](const CAncestor &a, const CAncestor &b) { return a.index < b.index; });
+
+            // merge with the line of the other parent, the closer one wins
+            vector<CAncestor> merged;
+            auto a = ancestors.begin(), b = line.begin();
+            while (a != ancestors.end() || b != line.end()) {
+                if (b == line.end() || (a != ancestors.end() && a->index < b->index)) {
+                    merged.push_back(*a++);
+                } else if (a == ancestors.end() || b->index < a->index) {
+                    merged.push_back(*b++);
+                } else {
+                    merged.push_back(b->generations < a->generations ? *b : *a);
+                    ++a, ++b;
+                }
+            }
+            ancestors.swap(merged);
+        }
+        m_Ancestors.resize(index + 1);
+        m_Ancestors[index] = move(ancestors);
+    }
+
+    // generations from the person at index up to ancestor, 0 for the person themself, NONE if not known
+    int Generations(int index, int ancestor) const {
+        if (index == ancestor) {
+            return 0;
+        }
+        const CAncestor *found = _find(index, ancestor);
+        return found != nullptr ? found->generations : CFamilyGraph::NONE;
+    }
+
+    // the parent of the person at index the closest line to ancestor goes through
+    int Via(const CFamilyGraph &graph, int index, int ancestor) const {
+        int generations = Generations(index, ancestor);
+        for (int parent : {graph.Father(index), graph.Mother(index)}) {
+            if (parent != CFamilyGraph::NONE && Generations(parent, ancestor) == generations - 1) {
+                return parent;
+            }
+        }
+        return CFamilyGraph::NONE;
+    }
+
+    // the common ancestor (either of the two persons included) with the shortest line through it, or NONE
+    int Nearest(int first, int second, int &length) const {
+        int nearest = CFamilyGraph::NONE;
+        auto candidate = [&](int ancestor, int generations) {
+            if (nearest == CFamilyGraph::NONE || generations < length) {
+                nearest = ancestor;
+                length = generations;
+            }
+        };
+        if (Generations(first, second) != CFamilyGraph::NONE) {
+            candidate(second, Generations(first, second));
+        }
+        if (Generations(second, first) != CFamilyGraph::NONE) {
+            candidate(first, Generations(second, first));
+        }
+        const vector<CAncestor> &a = m_Ancestors[first], &b = m_Ancestors[second];
+        for (size_t i = 0, j = 0; i < a.size() && j < b.size();) {
+            if (a[i].index < b[j].index) {
+                i++;
+            } else if (b[j].index < a[i].index) {
+                j++;
+            } else {
+                candidate(a[i].index, a[i].generations + b[j].generations);
+                i++, j++;
+            }
+        }
+        return nearest;
+    }
+};
+
 class CRegister {
    private:
     class CRecord {
@@ -161,6 +387,8 @@ class CRegister {
         shared_ptr<CPerson> person;
         shared_ptr<CPerson> father;
         shared_ptr<CPerson> mother;
+        // of the person in m_Graph
+        int index = CFamilyGraph::NONE;
 
         CRecord() = delete;
         CRecord(shared_ptr<CPerson> _person, shared_ptr<CPerson> _father, shared_ptr<CPerson> _mother) : person(_person),
@@ -168,17 +396,112 @@ class CRegister {
                                                                                                          mother(_mother) {}
         CRecord(const CRecord &old) : person(old.person),
                                       father(old.father),
-                                      mother(old.mother) {}
+                                      mother(old.mother),
+                                      index(old.index) {}
     };
+
+    // how a search reached an index: from which one, what the person is to it and how far from the start
+    struct CStep {
+        int from;
+        ERel rel;
+        size_t depth;
+    };
+    using TVisited = unordered_map<int, CStep>;
+
     map<int, shared_ptr<CRecord>> m_Data;
+    shared_ptr<CNameIndex> m_Names = make_shared<CNameIndex>();
+    CFamilyGraph m_Graph;
+    CAncestorIndex m_Ancestors;
+
+    // parents outside of the register are not linked in the graph
+    int _index(const shared_ptr<CPerson> &person) const {
+        if (person == nullptr) {
+            return CFamilyGraph::NONE;
+        }
+        auto found = m_Data.find(person->GetID());
+        return found != m_Data.end() && found->second->person == person ? found->second->index : CFamilyGraph::NONE;
+    }
+
+    // what the person at index is to its relative, when the relative is rel to it
+    ERel _inverse(int index, ERel rel) const {
+        bool man = m_Graph.Man(index);
+        if (rel == ERel::REL_FATHER || rel == ERel::REL_MOTHER) {
+            return man ? ERel::REL_SON : ERel::REL_DAUGHTER;
+        }
+        return man ? ERel::REL_FATHER : ERel::REL_MOTHER;
+    }
+
+    // expands one whole level of a search, returns the index visited by the other search closest to its start
+    int _expand(vector<int> &frontier, TVisited &visited, const TVisited &other) const {
+        vector<int> next;
+        int meet = CFamilyGraph::NONE;
+        for (int index : frontier) {
+            size_t depth = visited.at(index).depth + 1;
+            m_Graph.ForEachRelative(index, [&](int relative, ERel rel) {
+                if (!visited.emplace(relative, CStep{index, rel, depth}).second) {
+                    return;
+                }
+                next.push_back(relative);
+                auto found = other.find(relative);
+                if (found != other.end() && (meet == CFamilyGraph::NONE || found->second.depth < other.at(meet).depth)) {
+                    meet = relative;
+                }
+            });
+        }
+        frontier.swap(next);
+        return meet;
+    }
+
+    shared_ptr<CPerson> _person(int index) const {
+        return m_Data.at(m_Graph.ID(index))->person;
+    }
+
+    // up the closest line from first to ancestor, then down to second
+    list<pair<shared_ptr<CPerson>, ERel>> _line(int first, int second, int ancestor) const {
+        list<pair<shared_ptr<CPerson>, ERel>> result;
+        for (int it = first; it != ancestor;) {
+            it = m_Ancestors.Via(m_Graph, it, ancestor);
+            result.push_back({_person(it), m_Graph.Man(it) ? ERel::REL_FATHER : ERel::REL_MOTHER});
+        }
+        auto down = result.end();
+        for (int it = second; it != ancestor; it = m_Ancestors.Via(m_Graph, it, ancestor)) {
+            down = result.insert(down, {_person(it), m_Graph.Man(it) ? ERel::REL_SON : ERel::REL_DAUGHTER});
+        }
+        return result;
+    }
 
    public:
+    CRegister() = default;
+
+    // the persons are shared, the name index is not (persons added to one copy are not found in the other)
+    CRegister(const CRegister &other)
+        : m_Data(other.m_Data), m_Names(make_shared<CNameIndex>(*other.m_Names)), m_Graph(other.m_Graph), m_Ancestors(other.m_Ancestors) {
+        for (const auto &it : m_Data) {
+            it.second->person->FollowNameIndex(m_Names);
+        }
+    }
+
+    CRegister &operator=(const CRegister &other) {
+        if (this != &other) {
+            CRegister copy(other);
+            swap(m_Data, copy.m_Data);
+            swap(m_Names, copy.m_Names);
+            swap(m_Graph, copy.m_Graph);
+            swap(m_Ancestors, copy.m_Ancestors);
+        }
+        return *this;
+    }
+
     bool Add(shared_ptr<CPerson> person, shared_ptr<CPerson> father, shared_ptr<CPerson> mother) {
         // check if person ID already exists in database
         if (m_Data.find(person->GetID()) != m_Data.end()) {
             return false;
         }
+        int index = m_Graph.Add(person->GetID(), person->Type() == "Man", _index(father), _index(mother));
         auto pair = m_Data.insert({person->GetID(), make_shared<CRecord>(CRecord(person, father, mother))});
+        pair.first->second->index = index;
+        m_Ancestors.Add(m_Graph, index);
+        person->AddNameIndex(m_Names);
         if (father != nullptr) {
             pair.first->second->father->AddDescendant(pair.first->second->person);
         }
@@ -201,85 +524,55 @@ class CRegister {
     vector<shared_ptr<CPerson>> FindByName(const string &prefix) const {
         vector<shared_ptr<CPerson>> result;
 
-        for (const auto &it : m_Data) {
-            if (it.second->person->prefixMatched(prefix)) {
-                result.push_back(it.second->person);
-            }
+        for (int id : m_Names->Find(prefix)) {
+            result.push_back(m_Data.at(id)->person);
         }
 
         return result;
     }
 
+    // the shortest path of relatives from id1 to id2, searched from both ends until they meet
     list<pair<shared_ptr<CPerson>, ERel>> FindRelativesNoExep(int id1, int id2) const {
         list<pair<shared_ptr<CPerson>, ERel>> result;
-        if (id1 == id2) {
-            // cout << "id1 == id2" << endl;
-            return result;
-        }
-
         auto firstRecord = m_Data.find(id1);
-        if (firstRecord == m_Data.end()) {
-            // cout << "Person specified by the id1 parameter not found." << endl;
-            return result;
-        }
-
         auto secondRecord = m_Data.find(id2);
-        if (secondRecord == m_Data.end()) {
-            // cout << "Person specified by the id2 parameter not found." << endl;
-            return result;
-        }
-
-        // check if ID corresponds for the first ID
-        if (firstRecord->second->father != nullptr && firstRecord->second->father->GetID() == id2) {
-            result.push_back({firstRecord->second->father, ERel::REL_FATHER});
-        } else if (firstRecord->second->mother != nullptr && firstRecord->second->mother->GetID() == id2) {
-            result.push_back({firstRecord->second->mother, ERel::REL_MOTHER});
-        }
-
-        // return a result if we have any
-        if (result.size() > 0) {
-            return result;
-        }
-
-        if (secondRecord->second->father != nullptr && secondRecord->second->father->GetID() == id1) {
-            result.push_back({secondRecord->second->person, secondRecord->second->person->Type() == "Man" ? ERel::REL_SON : ERel::REL_DAUGHTER});
-        } else if (secondRecord->second->mother != nullptr && secondRecord->second->mother->GetID() == id1) {
-            result.push_back({secondRecord->second->person, secondRecord->second->person->Type() == "Man" ? ERel::REL_SON : ERel::REL_DAUGHTER});
-        }
-
-        // return a result if we have any
-        if (result.size() > 0) {
+        if (id1 == id2 || firstRecord == m_Data.end() || secondRecord == m_Data.end()) {
             return result;
         }
 
-        if (firstRecord->second->father != nullptr) {
-            result = FindRelativesNoExep(id2, firstRecord->second->father->GetID());
-            if (result.size() > 0) {
-                result.push_back({secondRecord->second->person, ERel::REL_FATHER});
-                return result;
+        int first = firstRecord->second->index;
+        int second = secondRecord->second->index;
+        vector<int> forward{first}, backward{second};
+        TVisited forwardVisited{{first, {CFamilyGraph::NONE, ERel::REL_NONE, 0}}}, backwardVisited{{second, {CFamilyGraph::NONE, ERel::REL_NONE, 0}}};
+        int meet = CFamilyGraph::NONE;
+        // a line through a common ancestor bounds the search, only shorter paths are worth looking for
+        int bound = 0;
+        int ancestor = m_Ancestors.Nearest(first, second, bound);
+
+        // the smaller frontier grows by a whole level, so the first meeting gives a shortest path
+        for (int levels = 0; meet == CFamilyGraph::NONE && !forward.empty() && !backward.empty(); levels++) {
+            if (ancestor != CFamilyGraph::NONE && levels + 1 >= bound) {
+                return _line(first, second, ancestor);
             }
-        }
-        if (firstRecord->second->mother != nullptr) {
-            result = FindRelativesNoExep(id2, firstRecord->second->mother->GetID());
-            if (result.size() > 0) {
-                result.push_back({secondRecord->second->person, ERel::REL_MOTHER});
-                return result;
+            if (forward.size() <= backward.size()) {
+                meet = _expand(forward, forwardVisited, backwardVisited);
+            } else {
+                meet = _expand(backward, backwardVisited, forwardVisited);
             }
         }
+        if (meet == CFamilyGraph::NONE) {
+            return result;
+        }
 
-        if (secondRecord->second->father != nullptr) {
-            result = FindRelativesNoExep(id1, secondRecord->second->father->GetID());
-            if (result.size() > 0) {
-                result.push_back({firstRecord->second->person, secondRecord->second->person->Type() == "Man" ? ERel::REL_SON : ERel::REL_DAUGHTER});
-                return result;
-            }
+        // id1 up to the meeting point, every step says what the reached person is to the previous one
+        for (int it = meet; it != first; it = forwardVisited.at(it).from) {
+            result.push_front({_person(it), forwardVisited.at(it).rel});
         }
-        if (secondRecord->second->mother != nullptr) {
-            result = FindRelativesNoExep(id1, secondRecord->second->mother->GetID());
-            if (result.size() > 0) {
-                result.push_back({firstRecord->second->person, secondRecord->second->person->Type() == "Man" ? ERel::REL_SON : ERel::REL_DAUGHTER});
-                return result;
-            }
+        // and on to id2, the backward steps were taken the other way round
+        for (int it = meet; it != second;) {
+            int next = backwardVisited.at(it).from;
+            result.push_back({_person(next), _inverse(next, backwardVisited.at(it).rel)});
+            it = next;
         }
         return result;
     }
@@ -372,6 +665,9 @@ int main(void) {
                  r.FindByID(150), r.FindByID(103)) == true);
 
     r.Add(make_shared<CWoman>(420, "S"), nullptr, nullptr);
+    assert(vectorMatch(r.FindByName("Pearce S"), vector<string>{"12: Peant Sue [Peterson Sue, Smith Sue, Pearce Sue] (woman)"}));
+    assert(vectorMatch(r.FindByName("Peant S"), vector<string>{"12: Peant Sue [Peterson Sue, Smith Sue, Pearce Sue] (woman)"}));
+    assert(r.FindByName("Peterson Sue ").empty() && r.FindByName("").size() == 19);
     for (const auto &it : r.FindByName("S")) {
         cout << *it << endl;
     }
@@ -471,6 +767,12 @@ int main(void) {
                                                    {"200: Pershing Peter (man)", ERel::REL_SON},
                                                    {"150: Pershing Joe (man)", ERel::REL_FATHER},
                                                    {"13: Pershing John (man)", ERel::REL_FATHER}}));
+    assert(listMatch(r.FindRelatives(102, 100), list<pair<string, ERel>>{
+                                                   {"10: Smith Samuel (man)", ERel::REL_FATHER},
+                                                   {"100: Smith John (man)", ERel::REL_SON}}));
+    assert(listMatch(r.FindRelatives(200, 11), list<pair<string, ERel>>{
+                                                   {"103: Smith Eve (woman)", ERel::REL_MOTHER},
+                                                   {"11: Peterson Jane (woman)", ERel::REL_MOTHER}}));
     assert(listMatch(r.FindRelatives(100, 2), list<pair<string, ERel>>{}));
     try {
         r.FindRelatives(100, 3);
@@ -486,6 +788,23 @@ int main(void) {
     } catch (...) {
         assert("An unexpected exception thrown");
     }
+    CRegister copy(r);
+    assert(copy.Add(make_shared<CMan>(500, "Zed Adam"), nullptr, nullptr) == true);
+    assert(r.Add(make_shared<CWoman>(500, "Zed Berta"), nullptr, nullptr) == true);
+    assert(r.FindByName("Zed Adam").empty() && copy.FindByName("Zed Berta").empty() && copy.FindByName("Zed").size() == 1);
+    dynamic_cast<CWoman &>(*r.FindByID(420)).Wedding("Sinclair");
+    assert(r.FindByName("Sinclair").size() == 1 && copy.FindByName("Sinclair").size() == 1);
+    copy = r;
+    assert(vectorMatch(copy.FindByName("Zed"), vector<string>{"500: Zed Berta (woman)"}));
+    // the index only knows four generations back, the line through the sixth one is found by the search
+    CRegister lines;
+    assert(lines.Add(make_shared<CMan>(1000, "Root"), nullptr, nullptr) == true);
+    for (int i = 1; i <= 6; i++) {
+        assert(lines.Add(make_shared<CMan>(1000 + i, "Left"), lines.FindByID(i == 1 ? 1000 : 999 + i), nullptr) == true);
+        assert(lines.Add(make_shared<CMan>(1100 + i, "Right"), lines.FindByID(i == 1 ? 1000 : 1099 + i), nullptr) == true);
+    }
+    assert(lines.FindRelatives(1002, 1102).size() == 4 && lines.FindRelatives(1006, 1106).size() == 12);
+    assert(lines.FindRelatives(1006, 1106).front().second == ERel::REL_FATHER && lines.FindRelatives(1006, 1106).back().second == ERel::REL_SON);
     return 0;
 }
 #endif /* __PROGTEST__ */
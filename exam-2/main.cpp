@@ -1,6 +1,8 @@
 #ifndef __PROGTEST__
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
@@ -11,117 +13,196 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <sstream>
 #include <stack>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 using namespace std;
 #endif /* __PROGTEST__ */
 
+// first day of every month within a year, counted from 0, the calendar has no leap years
+static constexpr int MONTH_START[13] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365};
+
+// month (1 - 12) of every day of a year
+struct CMonthOfDay {
+    unsigned char month[365];
+
+    constexpr CMonthOfDay() : month() {
+        for (int m = 1; m <= 12; m++) {
+            for (int d = MONTH_START[m - 1]; d < MONTH_START[m]; d++) {
+                month[d] = m;
+            }
+        }
+    }
+};
+static constexpr CMonthOfDay MONTH_OF_DAY{};
+
+/**
+ * @brief Date as a serial number of days since 0000-01-01 (of a calendar with 365 days every year),
+ * the arithmetic and comparisons are done on the number, year, month and day are derived from it
+ */
 class CDate {
    private:
-    int m_Year;
-    int m_Month;
-    int m_Day;
+    int m_Serial;
+
+    static constexpr int _year(int serial) { return serial / 365; }
+    static constexpr int _dayOfYear(int serial) { return serial % 365; }
 
    public:
-    CDate(int year, int month, int day) : m_Year(year), m_Month(month), m_Day(day) {}
+    constexpr CDate(int year, int month, int day) : m_Serial(year * 365 + MONTH_START[month - 1] + day - 1) {}
 
-    int Year() const { return m_Year; }
-    int Month() const { return m_Month; }
-    int Day() const { return m_Day; }
+    static constexpr CDate FromSerial(int serial) {
+        CDate date(0, 1, 1);
+        date.m_Serial = serial;
+        return date;
+    }
+
+    constexpr int Serial() const { return m_Serial; }
+    constexpr int Year() const { return _year(m_Serial); }
+    constexpr int Month() const { return MONTH_OF_DAY.month[_dayOfYear(m_Serial)]; }
+    constexpr int Day() const { return _dayOfYear(m_Serial) - MONTH_START[Month() - 1] + 1; }
+
+    // the whole batch at once, for reports over many dates
+    static void Split(const int *serials, size_t count, int *years, int *months, int *days) {
+        for (size_t i = 0; i < count; i++) {
+            int dayOfYear = _dayOfYear(serials[i]);
+            int month = MONTH_OF_DAY.month[dayOfYear];
+            years[i] = _year(serials[i]);
+            months[i] = month;
+            days[i] = dayOfYear - MONTH_START[month - 1] + 1;
+        }
+    }
 
     void SubYears(int years) {
         if (years < 1) return;
-        m_Year -= years;
+        m_Serial -= years * 365;
     }
 
+    // the day is cut down to the length of the month reached
     void SubMonths(int months) {
         if (months < 1) return;
 
-        if (months < 12)
-            if (m_Month > months)
-                m_Month -= months;
-            else {
-                SubYears(1);
-                m_Month = 12 - (months - m_Month);
-                // m_Month = 12 - (m_Month - months);
-            }
-        else {
-            int years = months / 12;
-            SubYears(years);
-            m_Month -= months - (years * 12);
-        }
+        int month = Year() * 12 + Month() - 1 - months;
+        int day = min(Day(), MONTH_START[month % 12 + 1] - MONTH_START[month % 12]);
+        *this = CDate(month / 12, month % 12 + 1, day);
     }
 
     void SubDays(int days) {
         if (days < 1) return;
+        m_Serial -= days;
+    }
 
-        static int monthDays[] = {0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    friend constexpr bool operator<(const CDate &first, const CDate &second) { return first.m_Serial < second.m_Serial; }
+    friend constexpr bool operator>(const CDate &first, const CDate &second) { return first.m_Serial > second.m_Serial; }
+    friend constexpr bool operator<=(const CDate &first, const CDate &second) { return first.m_Serial <= second.m_Serial; }
+    friend constexpr bool operator>=(const CDate &first, const CDate &second) { return first.m_Serial >= second.m_Serial; }
+    friend constexpr bool operator==(const CDate &first, const CDate &second) { return first.m_Serial == second.m_Serial; }
+    friend constexpr bool operator!=(const CDate &first, const CDate &second) { return first.m_Serial != second.m_Serial; }
 
-        if (days < monthDays[Month()])
-            if (m_Day > days)
-                m_Day -= days;
-            else {
-                SubMonths(1);
-                m_Day = monthDays[Month()] - (days - m_Day);
-            }
-        else {
-            SubMonths(1);
-            if (days - monthDays[Month()] > 0)
-                SubDays(days - monthDays[Month()]);
-            else if (days - monthDays[Month()] < 0) {
-                m_Day += monthDays[Month()] - days;
-            }
-        }
+    friend ostream &operator<<(ostream &os, const CDate &d) {
+        os << setw(4) << setfill('0') << d.Year() << "-";
+        os << setw(2) << setfill('0') << d.Month() << "-";
+        return os << setw(2) << setfill('0') << d.Day();
     }
+};
 
-    friend bool operator<(const CDate &first, const CDate &second) {
-        if (first.Year() < second.Year()) {
-            return true;
-        } else if (first.Year() != second.Year()) {
-            return false;
-        }
+class CPerson;
 
-        if (first.Month() < second.Month()) {
-            return true;
-        } else if (first.Month() != second.Month()) {
-            return false;
-        }
+/**
+ * @brief Parents and kids of the persons of a register, addressed by dense indexes given in the order
+ * of adding. The parents of all persons share one array, the kids of each person are appended to
+ * their own list as they are added.
+ */
+class CFamilyGraph {
+   public:
+    static constexpr int NONE = -1;
 
-        if (first.Day() < second.Day()) {
-            return true;
-        }
+    // a contiguous run of indexes
+    struct CRange {
+        const int *first;
+        const int *last;
 
-        return false;
-    }
+        const int *begin() const { return first; }
+        const int *end() const { return last; }
+        size_t size() const { return last - first; }
+    };
 
-    friend bool operator>(const CDate &first, const CDate &second) {
-        if (first.Year() > second.Year()) {
-            return true;
-        } else if (first.Year() != second.Year()) {
-            return false;
+   private:
+    vector<int> m_Ids;
+    // owned by the register
+    vector<CPerson *> m_Persons;
+    // parents of index i are m_Parents[m_ParentStart[i]] ... m_Parents[m_ParentStart[i + 1] - 1]
+    vector<int> m_ParentStart{0};
+    vector<int> m_Parents;
+    vector<vector<int>> m_Kids;
+    // persons whose retirement date may have changed since the last TakeStale
+    vector<int> m_Stale;
+    vector<char> m_IsStale;
+
+   public:
+    int Add(int id, CPerson *person, const vector<int> &parents) {
+        m_Ids.push_back(id);
+        m_Persons.push_back(person);
+        m_Parents.insert(m_Parents.end(), parents.begin(), parents.end());
+        m_ParentStart.push_back(m_Parents.size());
+        int index = int(m_Ids.size()) - 1;
+        m_Kids.emplace_back();
+        for (int parent : parents) {
+            m_Kids[parent].push_back(index);
         }
+        return index;
+    }
 
-        if (first.Month() > second.Month()) {
-            return true;
-        } else if (first.Month() != second.Month()) {
-            return false;
+    size_t Size() const { return m_Ids.size(); }
+    int ID(int index) const { return m_Ids[index]; }
+    CPerson &Person(int index) const { return *m_Persons[index]; }
+    void SetPerson(int index, CPerson *person) { m_Persons[index] = person; }
+
+    void MarkStale(int index) {
+        m_IsStale.resize(m_Ids.size(), false);
+        if (!m_IsStale[index]) {
+            m_IsStale[index] = true;
+            m_Stale.push_back(index);
         }
+    }
 
-        if (first.Day() > second.Day()) {
-            return true;
+    vector<int> TakeStale() {
+        for (int it : m_Stale) {
+            m_IsStale[it] = false;
         }
+        vector<int> stale;
+        stale.swap(m_Stale);
+        return stale;
+    }
 
-        return false;
+    CRange Parents(int index) const {
+        return {m_Parents.data() + m_ParentStart[index], m_Parents.data() + m_ParentStart[index + 1]};
     }
 
-    friend ostream &operator<<(ostream &os, const CDate &d) {
-        os << setw(4) << setfill('0') << d.Year() << "-";
-        os << setw(2) << setfill('0') << d.Month() << "-";
-        return os << setw(2) << setfill('0') << d.Day();
+    CRange Kids(int index) const {
+        return {m_Kids[index].data(), m_Kids[index].data() + m_Kids[index].size()};
+    }
+
+    // every ancestor once, a shared ancestor is walked only from the first path reaching them
+    vector<int> Ancestors(int index) const {
+        vector<int> result;
+        set<int> seen;
+        vector<int> stack{index};
+        while (!stack.empty()) {
+            int top = stack.back();
+            stack.pop_back();
+            for (int parent : Parents(top)) {
+                if (seen.insert(parent).second) {
+                    result.push_back(parent);
+                    stack.push_back(parent);
+                }
+            }
+        }
+        return result;
     }
 };
 
@@ -130,10 +211,37 @@ class CPerson {
     int m_Id;
     string m_Name;
     CDate m_DateBorn;
+    // the register the person was added to
+    weak_ptr<CFamilyGraph> m_Graph;
+    int m_Index = CFamilyGraph::NONE;
+    // valid until InvalidateRetireDate
+    bool m_RetireKnown = false;
+    CDate m_RetireDate{0, 1, 1};
 
    protected:
-    vector<weak_ptr<CPerson>> m_Parents;
-    vector<weak_ptr<CPerson>> m_Kids;
+    virtual CDate _computeRetireDate() {
+        throw logic_error("RetireDate is not implemented");
+    }
+
+    // a change of the person affects the retirement of the parents too
+    void _invalidateWithParents() {
+        InvalidateRetireDate();
+        if (shared_ptr<const CFamilyGraph> graph = m_Graph.lock()) {
+            for (int it : graph->Parents(m_Index)) {
+                graph->Person(it).InvalidateRetireDate();
+            }
+        }
+    }
+
+    // sons and daughters alike
+    template <typename TFn>
+    void _forEachKid(TFn &&fn) const {
+        if (shared_ptr<const CFamilyGraph> graph = m_Graph.lock()) {
+            for (int it : graph->Kids(m_Index)) {
+                fn(graph->Person(it));
+            }
+        }
+    }
 
    public:
     CPerson() = delete;
@@ -147,51 +255,48 @@ class CPerson {
     const string &Name() const { return m_Name; }
     const CDate &DateBorn() const { return m_DateBorn; }
 
+    // the links are not copied, they belong to the register
     virtual shared_ptr<CPerson> Clone() const {
-        shared_ptr<CPerson> s = make_shared<CPerson>(this->GetID(), this->Name(), this->DateBorn());
-        for (auto const &it : this->m_Parents) {
-            shared_ptr<CPerson> p = it.lock();
-            if (p) {
-                s->AddParent(p->Clone());
-            }
-        }
-        for (auto const &it : this->m_Kids) {
-            shared_ptr<CPerson> p = it.lock();
-            if (p) {
-                s->AddKid(p->Clone());
-            }
+        return make_shared<CPerson>(this->GetID(), this->Name(), this->DateBorn());
+    }
+
+    CDate RetireDate() {
+        if (!m_RetireKnown) {
+            m_RetireDate = _computeRetireDate();
+            m_RetireKnown = true;
         }
-        return s;
+        return m_RetireDate;
     }
 
-    virtual CDate RetireDate() {
-        throw logic_error("RetireDate is not implemented");
+    void InvalidateRetireDate() {
+        m_RetireKnown = false;
+        if (shared_ptr<CFamilyGraph> graph = m_Graph.lock()) {
+            graph->MarkStale(m_Index);
+        }
     }
 
     virtual const string Type() const {
         throw logic_error("Type is not implemented");
     }
 
-    void AddParent(shared_ptr<CPerson> person) {
-        m_Parents.push_back(person);
-    };
+    int Index() const { return m_Index; }
 
-    void AddKid(shared_ptr<CPerson> person) {
-        m_Kids.push_back(person);
-    };
+    void Attach(const shared_ptr<CFamilyGraph> &graph, int index) {
+        m_Graph = graph;
+        m_Index = index;
+    }
 
     virtual bool WasInMilitary() const { return false; }
 
     // set<string> ScanPedigree ()
     set<string> ScanPedigree() {
         set<string> result;
-        for (size_t i = 0; i < m_Parents.size(); ++i) {
-            shared_ptr<CPerson> p = m_Parents[i].lock();
-            if (p) {
-                result.insert(p->Name());
-                set<string> prevPedigrees = p->ScanPedigree();
-                result.insert(prevPedigrees.begin(), prevPedigrees.end());
-            }
+        shared_ptr<const CFamilyGraph> graph = m_Graph.lock();
+        if (!graph) {
+            return result;
+        }
+        for (int it : graph->Ancestors(m_Index)) {
+            result.insert(graph->Person(it).Name());
         }
         return result;
     }
@@ -219,19 +324,8 @@ class CMan : public CPerson {
     ~CMan() = default;
 
     shared_ptr<CPerson> Clone() const override {
-        shared_ptr<CPerson> s = make_shared<CMan>(this->GetID(), this->Name(), this->DateBorn());
-        for (auto const &it : m_Parents) {
-            shared_ptr<CPerson> p = it.lock();
-            if (p) {
-                s->AddParent(p);
-            }
-        }
-        for (auto const &it : m_Kids) {
-            shared_ptr<CPerson> p = it.lock();
-            if (p) {
-                s->AddKid(p);
-            }
-        }
+        shared_ptr<CMan> s = make_shared<CMan>(this->GetID(), this->Name(), this->DateBorn());
+        s->m_MilitaryLog = m_MilitaryLog;
         return s;
     }
 
@@ -241,17 +335,17 @@ class CMan : public CPerson {
 
     bool WasInMilitary() const override { return m_MilitaryLog.size() > 0; }
 
-    CDate RetireDate() override {
-        // TODO save this result into a variable and only recalculate when needed
-
+   protected:
+    CDate _computeRetireDate() override {
         const CDate &bornDate = DateBorn();
 
-        // Sort the vector so it's sorted from the highest to the lowest
-        sort(m_MilitaryLog.begin(), m_MilitaryLog.end(), greater<int>());
+        // Sort a copy so it's sorted from the highest to the lowest (the log is read by the parents meanwhile)
+        vector<int> militaryLog = m_MilitaryLog;
+        sort(militaryLog.begin(), militaryLog.end(), greater<int>());
 
         // Calculate base retire date (+ 65 years for men)
         CDate retireDate = CDate(bornDate.Year() + 65, bornDate.Month(), bornDate.Day());
-        for (size_t i = 0; i < m_MilitaryLog.size(); ++i) {
+        for (size_t i = 0; i < militaryLog.size(); ++i) {
             int multiplicator = 1;
             // doba strávená na nejdelším vojenském cvičení se odečte 4x,
             if (i == 0)
@@ -264,15 +358,14 @@ class CMan : public CPerson {
                 multiplicator = 2;
             // ostatní vojenská cvičení se odečítají podle své délky bez zvýhodnění,
 
-            retireDate.SubDays(multiplicator * (m_MilitaryLog[i]));
+            retireDate.SubDays(multiplicator * (militaryLog[i]));
         }
 
         // odečte se 10 dní za každého syna, který byl alespoň 1 den na vojenském cvičení,
-        for (size_t i = 0; i < m_Kids.size(); ++i) {
-            shared_ptr<CPerson> p = m_Kids[i].lock();
-            if (p && p->WasInMilitary())
+        _forEachKid([&retireDate](const CPerson &kid) {
+            if (kid.WasInMilitary())
                 retireDate.SubDays(10);
-        }
+        });
 
         // maximálně lze odečíst 20 let
         if (CDate(bornDate.Year() + 65 - 20, bornDate.Month(), bornDate.Day()) < retireDate)
@@ -281,9 +374,11 @@ class CMan : public CPerson {
             return CDate(bornDate.Year() + 65 - 20, bornDate.Month(), bornDate.Day());
     }
 
+   public:
     void Military(int days) {
         if (days > 0) {
             m_MilitaryLog.push_back(days);
+            _invalidateWithParents();
         }
     }
 };
@@ -295,29 +390,15 @@ class CWoman : public CPerson {
     ~CWoman() = default;
 
     shared_ptr<CPerson> Clone() const override {
-        shared_ptr<CPerson> s = make_shared<CWoman>(this->GetID(), this->Name(), this->DateBorn());
-        for (size_t i = 0; i < m_Parents.size(); ++i) {
-            shared_ptr<CPerson> p = m_Parents[i].lock();
-            if (p) {
-                s->AddParent(p);
-            }
-        }
-        for (size_t i = 0; i < m_Kids.size(); ++i) {
-            shared_ptr<CPerson> p = m_Kids[i].lock();
-            if (p) {
-                s->AddKid(p);
-            }
-        }
-        return s;
+        return make_shared<CWoman>(this->GetID(), this->Name(), this->DateBorn());
     }
 
     const string Type() const override {
         return "woman";
     }
 
-    CDate RetireDate() override {
-        // TODO save this result into a variable and only recalculate when needed
-
+   protected:
+    CDate _computeRetireDate() override {
         const CDate &bornDate = DateBorn();
 
         // Calculate base retire date (+ 60 years for women)
@@ -325,13 +406,12 @@ class CWoman : public CPerson {
 
         // za každé dítě se oba odchodu do důchodu zkracuje o 4 roky
         // odečte se 10 dní za každého syna, který byl alespoň 1 den na vojenském cvičení,
-        for (size_t i = 0; i < m_Kids.size(); ++i) {
-            shared_ptr<CPerson> p = m_Kids[i].lock();
+        _forEachKid([&retireDate](const CPerson &kid) {
             retireDate.SubYears(4);
 
-            if (p && p->WasInMilitary())
+            if (kid.WasInMilitary())
                 retireDate.SubDays(10);
-        }
+        });
 
         // maximálně lze odečíst 20 let
         if (CDate(bornDate.Year() + 60 - 20, bornDate.Month(), bornDate.Day()) < retireDate)
@@ -341,20 +421,234 @@ class CWoman : public CPerson {
     }
 };
 
+/**
+ * @brief Threads started once and reused by every ParallelFor. A job is a range cut into chunks, every worker
+ * takes the chunks of its own queue from the back and steals from the front of the other queues when it runs out.
+ */
+class CWorkerPool {
+   private:
+    struct CQueue {
+        mutex lock;
+        deque<pair<size_t, size_t>> chunks;
+    };
+    // queue 0 belongs to the thread calling Run
+    vector<unique_ptr<CQueue>> m_Queues;
+    vector<thread> m_Threads;
+    // one job at a time
+    mutex m_RunLock;
+    mutex m_Lock;
+    condition_variable m_Wake;
+    condition_variable m_Done;
+    const function<void(size_t, size_t)> *m_Job = nullptr;
+    size_t m_Round = 0;
+    // chunks of the job not finished yet and workers that may still hold the job
+    size_t m_Left = 0;
+    size_t m_Busy = 0;
+    bool m_Stop = false;
+
+    bool _take(size_t self, pair<size_t, size_t> &chunk) {
+        for (size_t k = 0; k < m_Queues.size(); k++) {
+            CQueue &queue = *m_Queues[(self + k) % m_Queues.size()];
+            lock_guard<mutex> lock(queue.lock);
+            if (!queue.chunks.empty()) {
+                if (k == 0) {
+                    chunk = queue.chunks.back();
+                    queue.chunks.pop_back();
+                } else {
+                    chunk = queue.chunks.front();
+                    queue.chunks.pop_front();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _drain(size_t self, const function<void(size_t, size_t)> &job) {
+        for (pair<size_t, size_t> chunk; _take(self, chunk);) {
+            job(chunk.first, chunk.second);
+            lock_guard<mutex> lock(m_Lock);
+            if (--m_Left == 0) {
+                m_Done.notify_all();
+            }
+        }
+    }
+
+    void _work(size_t self) {
+        size_t round = 0;
+        unique_lock<mutex> lock(m_Lock);
+        while (true) {
+            m_Wake.wait(lock, [&] { return m_Stop || m_Round != round; });
+            if (m_Stop) {
+                return;
+            }
+            round = m_Round;
+            if (m_Job == nullptr) {
+                continue;
+            }
+            const function<void(size_t, size_t)> &job = *m_Job;
+            m_Busy++;
+            lock.unlock();
+            _drain(self, job);
+            lock.lock();
+            if (--m_Busy == 0) {
+                m_Done.notify_all();
+            }
+        }
+    }
+
+   public:
+    explicit CWorkerPool(size_t workers) {
+        for (size_t i = 0; i < max<size_t>(workers, 1); i++) {
+            m_Queues.push_back(make_unique<CQueue>());
+        }
+        for (size_t i = 1; i < m_Queues.size(); i++) {
+            m_Threads.emplace_back(&CWorkerPool::_work, this, i);
+        }
+    }
+
+    CWorkerPool(const CWorkerPool &) = delete;
+    CWorkerPool &operator=(const CWorkerPool &) = delete;
+
+    ~CWorkerPool() {
+        {
+            lock_guard<mutex> lock(m_Lock);
+            m_Stop = true;
+        }
+        m_Wake.notify_all();
+        for (thread &it : m_Threads) {
+            it.join();
+        }
+    }
+
+    // one worker per hardware thread, the calling thread being one of them
+    static CWorkerPool &Instance() {
+        static CWorkerPool pool(thread::hardware_concurrency());
+        return pool;
+    }
+
+    // including the thread calling Run
+    size_t Workers() const { return m_Queues.size(); }
+
+    // job(first, last) for consecutive chunks of [0, count), every worker starts with its own share of them
+    void Run(size_t count, size_t chunk, const function<void(size_t, size_t)> &job) {
+        lock_guard<mutex> run(m_RunLock);
+        size_t chunks = (count + chunk - 1) / chunk;
+        if (chunks == 0) {
+            return;
+        }
+        for (size_t i = 0; i < chunks; i++) {
+            CQueue &queue = *m_Queues[i * m_Queues.size() / chunks];
+            lock_guard<mutex> lock(queue.lock);
+            // the back is taken first, so the share is stored from its end
+            queue.chunks.push_front({i * chunk, min(count, (i + 1) * chunk)});
+        }
+        {
+            lock_guard<mutex> lock(m_Lock);
+            m_Job = &job;
+            m_Left = chunks;
+            m_Round++;
+        }
+        m_Wake.notify_all();
+        _drain(0, job);
+        unique_lock<mutex> lock(m_Lock);
+        m_Done.wait(lock, [this] { return m_Left == 0 && m_Busy == 0; });
+        m_Job = nullptr;
+    }
+};
+
+// calls fn(i) for every i < count on the workers of the pool
+template <typename TFn>
+void ParallelFor(size_t count, TFn &&fn, CWorkerPool &pool = CWorkerPool::Instance()) {
+    const size_t CHUNK = 256;
+    if (pool.Workers() <= 1 || count <= CHUNK) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+    pool.Run(count, CHUNK, [&fn](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            fn(i);
+        }
+    });
+}
+
+/**
+ * @brief Persons of a register ordered by their retirement dates. The graph only collects the persons
+ * whose dates may have changed, their entries are moved by Refresh before the index is searched.
+ */
+class CRetirementIndex {
+   private:
+    // serial number of the retirement date and graph index
+    set<pair<int, int>> m_Order;
+    // the serial number every graph index is stored under, NONE before the first Refresh
+    vector<int> m_Keys;
+
+   public:
+    // the dates are computed in parallel, every person only writes their own cache
+    void Refresh(CFamilyGraph &graph) {
+        m_Keys.resize(graph.Size(), CFamilyGraph::NONE);
+        vector<int> stale = graph.TakeStale();
+        vector<int> keys(stale.size());
+        ParallelFor(stale.size(), [&](size_t i) {
+            keys[i] = graph.Person(stale[i]).RetireDate().Serial();
+        });
+
+        for (size_t i = 0; i < stale.size(); i++) {
+            int index = stale[i], key = keys[i];
+            if (m_Keys[index] == key) {
+                continue;
+            }
+            if (m_Keys[index] != CFamilyGraph::NONE) {
+                m_Order.erase({m_Keys[index], index});
+            }
+            m_Order.insert({key, index});
+            m_Keys[index] = key;
+        }
+    }
+
+    // serial numbers of the retirement dates by graph index, valid after Refresh
+    const vector<int> &Keys() const { return m_Keys; }
+
+    // graph indexes of the persons retiring from from to to (both included), in the order of the dates
+    template <typename TFn>
+    void ForEachBetween(const CDate &from, const CDate &to, TFn &&fn) const {
+        for (auto it = m_Order.lower_bound({from.Serial(), CFamilyGraph::NONE}); it != m_Order.end() && it->first <= to.Serial(); ++it) {
+            fn(it->second, it->first);
+        }
+    }
+};
+
 class CRegister {
    private:
     map<int, shared_ptr<CPerson>> m_Data;
+    shared_ptr<CFamilyGraph> m_Graph = make_shared<CFamilyGraph>();
+    // brought up to date by the searches
+    mutable CRetirementIndex m_Retirement;
+
+    // by the ID, the pointer may come from a copy of the register, parents not in the register are not linked
+    int _index(const shared_ptr<CPerson> &person) const {
+        auto found = m_Data.find(person->GetID());
+        return found != m_Data.end() ? found->second->Index() : CFamilyGraph::NONE;
+    }
 
    public:
     // default constructor
     CRegister() = default;
     ~CRegister() = default;
-    // copy constructor (if needed)
-    CRegister(const CRegister &old) {
-        for (auto const &it : old.m_Data) {
-            m_Data.insert({it.first, it.second->Clone()});
+    // copy constructor (if needed), a deep copy: the persons are cloned, the links and the index are plain
+    // arrays copied as they are
+    CRegister(const CRegister &old) : m_Graph(make_shared<CFamilyGraph>(*old.m_Graph)),
+                                      m_Retirement(old.m_Retirement) {
+        for (int i = 0; i < int(m_Graph->Size()); i++) {
+            shared_ptr<CPerson> copy = old.m_Data.at(m_Graph->ID(i))->Clone();
+            m_Graph->SetPerson(i, copy.get());
+            copy->Attach(m_Graph, i);
+            m_Data.insert({copy->GetID(), copy});
         }
     }
+    CRegister(CRegister &&old) = default;
 
     CRegister &operator=(CRegister &old) = delete;
 
@@ -364,14 +658,18 @@ class CRegister {
             return false;
         }
 
-        m_Data.insert({person->GetID(), person});
-        if (father != nullptr) {
-            father->AddKid(person);
-            person->AddParent(father);
+        vector<int> parents;
+        for (const shared_ptr<CPerson> &it : {father, mother}) {
+            if (it != nullptr && _index(it) != CFamilyGraph::NONE) {
+                parents.push_back(_index(it));
+            }
         }
-        if (mother != nullptr) {
-            mother->AddKid(person);
-            person->AddParent(mother);
+        m_Data.insert({person->GetID(), person});
+        person->Attach(m_Graph, m_Graph->Add(person->GetID(), person.get(), parents));
+        // the new kid counts for the parents, the person may have been asked before being added
+        person->InvalidateRetireDate();
+        for (int it : parents) {
+            m_Graph->Person(it).InvalidateRetireDate();
         }
 
         return true;
@@ -388,21 +686,47 @@ class CRegister {
 
     vector<shared_ptr<CPerson>> FindRetired(CDate from, CDate to) const {
         vector<shared_ptr<CPerson>> result;
-        // cout << "Looking through " << m_Data.size() << " records." << endl;
-        for (auto const &it : m_Data) {
-            shared_ptr<CPerson> p = it.second;
-            // cout << "Checking if\t" << *p << " is between " << from << " and " << to << endl;
-            CDate retireDate = p->RetireDate();
+        m_Retirement.Refresh(*m_Graph);
+        m_Retirement.ForEachBetween(from, to, [this, &result](int index, int) {
+            result.push_back(m_Data.at(m_Graph->ID(index)));
+        });
+        sort(result.begin(), result.end(), [](const shared_ptr<CPerson> &a, const shared_ptr<CPerson> &b) { return a->GetID() < b->GetID(); });
 
-            if (from > retireDate)
-                continue;
+        return result;
+    }
 
-            if (to < retireDate)
-                continue;
+    // retirement dates of all the persons as serial numbers, in the order they were added
+    vector<int> RetireDates() const {
+        m_Retirement.Refresh(*m_Graph);
+        return m_Retirement.Keys();
+    }
 
-            result.push_back(p);
+    // the same for the persons with the given IDs, NONE for the unknown ones
+    vector<int> RetireDates(const vector<int> &ids) const {
+        m_Retirement.Refresh(*m_Graph);
+        vector<int> result;
+        result.reserve(ids.size());
+        for (int id : ids) {
+            auto found = m_Data.find(id);
+            result.push_back(found != m_Data.end() ? m_Retirement.Keys()[found->second->Index()] : CFamilyGraph::NONE);
         }
+        return result;
+    }
 
+    // number of persons retiring in each of the months calendar months starting with the month of from
+    vector<size_t> RetiredByMonth(CDate from, int months) const {
+        vector<size_t> result(max(months, 0), 0);
+        if (months < 1) {
+            return result;
+        }
+        int first = from.Year() * 12 + from.Month() - 1;
+        int last = first + months - 1;
+        m_Retirement.Refresh(*m_Graph);
+        CDate lastDay(last / 12, last % 12 + 1, MONTH_START[last % 12 + 1] - MONTH_START[last % 12]);
+        m_Retirement.ForEachBetween(CDate(from.Year(), from.Month(), 1), lastDay, [&](int, int serial) {
+            CDate date = CDate::FromSerial(serial);
+            result[date.Year() * 12 + date.Month() - 1 - first]++;
+        });
         return result;
     }
 };
@@ -640,6 +964,9 @@ int main(void) {
     // compareTest1();
     // compareTest2();
     // subTest();
+    CDate date(1938, 12, 2);
+    date.SubDays(670);
+    assert(date == CDate(1937, 1, 31) && date.Serial() - CDate(1936, 1, 31).Serial() == 365);
 
     ostringstream oss;
     vector<CRegister> r;
@@ -756,6 +1083,8 @@ int main(void) {
     assert(vectorMatch(r[0].FindRetired(CDate(1975, 11, 29), CDate(1976, 6, 4)), vector<string>{
                                                                                      "10: Smith Samuel, man, born: 1930-11-29, retires: 1975-11-29",
                                                                                      "11: Peterson Jane, woman, born: 1932-06-04, retires: 1976-06-04"}));
+    assert((r[0].RetiredByMonth(CDate(1975, 11, 15), 8) == vector<size_t>{1, 0, 0, 0, 0, 0, 0, 1}));
+    assert((r[0].RetireDates({10, 11, 999}) == vector<int>{CDate(1975, 11, 29).Serial(), CDate(1976, 6, 4).Serial(), CFamilyGraph::NONE}));
     assert(r[0].FindByID(103)->GetID() == 103);
     oss.str("");
     oss << *r[0].FindByID(103);
@@ -807,6 +1136,93 @@ int main(void) {
     oss.str("");
     oss << *r[1].FindByID(11);
     assert(oss.str() == "11: Peterson Jane, woman, born: 1932-06-04, retires: 1976-06-04");
+    // the copy links its own persons, a son of the copy counts for the mother of the copy only
+    dynamic_cast<CMan &>(*r[1].FindByID(100)).Military(5);
+    oss.str("");
+    oss << *r[1].FindByID(11);
+    assert(oss.str() == "11: Peterson Jane, woman, born: 1932-06-04, retires: 1976-05-25");
+    oss.str("");
+    oss << *r[0].FindByID(11);
+    assert(oss.str() == "11: Peterson Jane, woman, born: 1932-06-04, retires: 1972-06-04");
+    assert(r[1].FindByID(103)->ScanPedigree() == r[0].FindByID(104)->ScanPedigree());
+
+    // a copy has persons of its own, the parent may come from before the copy
+    shared_ptr<CPerson> father = r[0].FindByID(10);
+    CRegister what(r[0]);
+    assert(what.RetiredByMonth(CDate(1972, 6, 1), 1) == r[0].RetiredByMonth(CDate(1972, 6, 1), 1));
+    assert(what.Add(make_shared<CMan>(105, "Smith Adam", CDate(1970, 1, 1)), father, what.FindByID(11)));
+    assert((what.RetiredByMonth(CDate(2035, 1, 1), 1) == vector<size_t>{1}) && (r[0].RetiredByMonth(CDate(2035, 1, 1), 1) == vector<size_t>{0}));
+    assert(what.FindByID(105)->ScanPedigree().count("Smith Samuel") && r[0].FindByID(105) == nullptr);
+    // pointers from before the copy keep belonging to the original
+    shared_ptr<CPerson> john = r[0].FindByID(13);
+    CRegister before(r[0]);
+    assert(r[0].FindByID(13) == john && before.FindByID(13) != john);
+    dynamic_cast<CMan &>(*john).Military(30);
+    assert(john->WasInMilitary() && !before.FindByID(13)->WasInMilitary());
+    // the copy is a snapshot even if the change comes before it is looked at
+    CRegister home;
+    assert(home.Add(make_shared<CMan>(300, "Novak Jan", CDate(1950, 1, 1)), nullptr, nullptr));
+    assert(home.Add(make_shared<CMan>(301, "Novak Petr", CDate(1975, 1, 1)), home.FindByID(300), nullptr));
+    shared_ptr<CPerson> petr = home.FindByID(301);
+    CRegister snapshot(home);
+    CRegister again(snapshot);
+    dynamic_cast<CMan &>(*petr).Military(10);
+    assert(home.RetiredByMonth(CDate(2014, 12, 1), 2) == (vector<size_t>{1, 0}));
+    assert(snapshot.RetiredByMonth(CDate(2014, 12, 1), 2) == (vector<size_t>{0, 1}) && again.RetireDates() == snapshot.RetireDates());
+    assert(!snapshot.FindByID(301)->WasInMilitary() && !again.FindByID(301)->WasInMilitary() && snapshot.FindByID(301) != again.FindByID(301));
+
+    // the dates computed by the pool match the ones asked for one by one, also after a change
+    auto populate = [](CRegister &reg) {
+        for (int i = 0; i < 3000; i++) {
+            CDate born(1900 + i % 100, 1 + i % 12, 1 + i % 28);
+            shared_ptr<CPerson> father = i >= 2 ? reg.FindByID((i / 2) & ~1) : nullptr;
+            shared_ptr<CPerson> mother = i >= 2 ? reg.FindByID(((i / 2) & ~1) + 1) : nullptr;
+            if (i % 2 == 0) {
+                assert(reg.Add(make_shared<CMan>(i, "Man " + to_string(i), born), father, mother));
+            } else {
+                assert(reg.Add(make_shared<CWoman>(i, "Woman " + to_string(i), born), father, mother));
+            }
+            if (i % 6 == 0) {
+                dynamic_cast<CMan &>(*reg.FindByID(i)).Military(i % 50 + 1);
+            }
+        }
+    };
+    CRegister batch, single;
+    populate(batch);
+    populate(single);
+    vector<int> dates;
+    for (int i = 0; i < 3000; i++) {
+        dates.push_back(single.FindByID(i)->RetireDate().Serial());
+    }
+    assert(batch.RetireDates() == dates);
+    int parent = dates[1200];
+    dynamic_cast<CMan &>(*batch.FindByID(2402)).Military(100);
+    dynamic_cast<CMan &>(*single.FindByID(2402)).Military(100);
+    for (int i : {2402, 1200, 1201}) {
+        dates[i] = single.FindByID(i)->RetireDate().Serial();
+    }
+    assert(batch.RetireDates() == dates && dates[1200] == parent - 10);
+    // a pool reused for several jobs, with more workers than the machine may have
+    CWorkerPool pool(4);
+    for (size_t count : {0, 100, 5000, 12345}) {
+        vector<atomic<int>> hits(count);
+        ParallelFor(count, [&hits](size_t i) { hits[i]++; }, pool);
+        assert(all_of(hits.begin(), hits.end(), [](const atomic<int> &it) { return it == 1; }));
+    }
+
+    // every person is a kid of both persons of the previous generation, 2^60 lines lead to the first two
+    CRegister inbred;
+    for (int i = 0; i < 120; i += 2) {
+        assert(inbred.Add(make_shared<CMan>(i, "Man " + to_string(i / 2), CDate(1900, 1, 1)), inbred.FindByID(i - 2), inbred.FindByID(i - 1)));
+        assert(inbred.Add(make_shared<CWoman>(i + 1, "Woman " + to_string(i / 2), CDate(1900, 1, 1)), inbred.FindByID(i - 2), inbred.FindByID(i - 1)));
+    }
+    assert(inbred.FindByID(118)->ScanPedigree().size() == 118 && inbred.FindByID(119)->ScanPedigree().count("Woman 0"));
+    // a long line of fathers, the ancestors are collected per query, not kept for every person of the line
+    CRegister line;
+    for (int i = 0; i < 3000; i++) {
+        assert(line.Add(make_shared<CMan>(i, "Man " + to_string(i), CDate(1900, 1, 1)), line.FindByID(i - 1), nullptr));
+    }
+    assert(line.FindByID(2999)->ScanPedigree().size() == 2999 && line.FindByID(1500)->ScanPedigree().count("Man 0"));
     return 0;
 }
 #endif /* __PROGTEST__ */
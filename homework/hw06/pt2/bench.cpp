@@ -0,0 +1,224 @@
+// Benchmark of the zone engine in dns.cpp (built without its assert based main):
+//   g++ -std=c++17 -O2 bench.cpp -o bench && ./bench [records ...]
+#define __PROGTEST__
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ipaddress.h"
+using namespace std;
+
+#include "dns.cpp"
+
+static atomic<size_t> g_allocations{0};
+
+// counting replacements of the global allocation functions, GCC cannot see they belong together
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    if (void *ptr = malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    free(ptr);
+}
+
+/**
+ * @brief Shape of a synthetic zone tree, every zone has breadth records and zoneShare of them are
+ * nested zones (while depth allows), the rest is spread over the record types by typeMix
+ */
+struct CTreeShape {
+    size_t breadth;
+    size_t depth;
+    double zoneShare;
+    // weights of A, AAAA, MX, CNAME, SPF
+    array<double, 5> typeMix;
+};
+
+class CBenchmark {
+   private:
+    mt19937 m_random{2024};
+    // dotted names of the (non zone) records of the last generated tree, relative to its root
+    vector<string> m_names;
+    size_t m_records = 0;
+
+    shared_ptr<CRecord> _record(const string &name, const array<double, 5> &typeMix) {
+        discrete_distribution<int> type(typeMix.begin(), typeMix.end());
+        uint32_t value = m_random();
+        switch (type(m_random)) {
+            case 0:
+                return make_shared<CRecA>(name, CIPv4(to_string(value >> 24) + "." + to_string(value >> 16 & 255) + "." +
+                                                     to_string(value >> 8 & 255) + "." + to_string(value & 255)));
+            case 1:
+                return make_shared<CRecAAAA>(name, CIPv6("2001:718:2:2902:0:1:" + to_string(value >> 16 & 0x1fff) + ":" +
+                                                         to_string(value & 0x1fff)));
+            case 2:
+                return make_shared<CRecMX>(name, "relay" + to_string(value % 100) + ".example.", value % 50);
+            case 3:
+                return make_shared<CRecCNAME>(name, "target" + to_string(value % 1000) + ".example.");
+            default:
+                return make_shared<CRecSPF>(CRecSPF(name).Add("ip4:147.32.232.128/25").Add("ip4:147.32.232.64/26"));
+        }
+    }
+
+    void _fill(CZone &zone, const CTreeShape &shape, size_t depth, const string &suffix) {
+        for (size_t i = 0; i < shape.breadth; i++) {
+            string name = "n" + to_string(i);
+            if (depth < shape.depth && (i + 1) <= shape.breadth * shape.zoneShare) {
+                CZone nested(name);
+                _fill(nested, shape, depth + 1, suffix.empty() ? name : name + "." + suffix);
+                zone.Add(nested);
+                continue;
+            }
+            zone.Add(*_record(name, shape.typeMix));
+            m_names.push_back(suffix.empty() ? name : name + "." + suffix);
+            m_records++;
+        }
+    }
+
+    struct CStats {
+        vector<double> latencies;
+        size_t allocations = 0;
+        double seconds = 0;
+    };
+
+    template <typename TOp>
+    static CStats _measure(size_t count, TOp &&op) {
+        CStats stats;
+        stats.latencies.reserve(count);
+        size_t allocations = g_allocations;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            auto opStart = chrono::steady_clock::now();
+            op(i);
+            stats.latencies.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - opStart).count());
+        }
+        stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        // the latencies vector was reserved up front, so it does not show up here
+        stats.allocations = g_allocations - allocations;
+        return stats;
+    }
+
+    static void _report(const string &label, size_t size, CStats stats) {
+        sort(stats.latencies.begin(), stats.latencies.end());
+        auto percentile = [&stats](double p) {
+            return stats.latencies[min(stats.latencies.size() - 1, size_t(p * stats.latencies.size()))];
+        };
+        size_t count = stats.latencies.size();
+        cout << left << setw(14) << label << right << setw(9) << size << fixed << setprecision(0) << setw(14)
+             << count / stats.seconds << setw(11) << percentile(0.5) << setw(11) << percentile(0.99) << setw(12)
+             << stats.latencies.back() << setprecision(2) << setw(10) << double(stats.allocations) / count << endl;
+    }
+
+   public:
+    CZone Tree(const CTreeShape &shape) {
+        m_names.clear();
+        m_records = 0;
+        CZone root("<ROOT ZONE>");
+        _fill(root, shape, 0, "");
+        return root;
+    }
+
+    void Run(size_t size) {
+        const size_t queries = 100000;
+
+        // flat zone: Add, Search, Del
+        vector<shared_ptr<CRecord>> records;
+        for (size_t i = 0; i < size; i++) {
+            records.push_back(_record("host" + to_string(i % (size / 4 + 1)), {4, 2, 1, 0, 1}));
+        }
+        CZone flat("flat");
+        _report("Add", size, _measure(size, [&](size_t i) { flat.Add(*records[i]); }));
+        vector<string> flatNames;
+        for (size_t i = 0; i < queries; i++) {
+            flatNames.push_back(records[m_random() % size]->Name());
+        }
+        const CZone &flatView = flat;
+        _report("Search", size, _measure(queries, [&](size_t i) { flatView.Search(flatNames[i]); }));
+        _report("Del", size, _measure(size, [&](size_t i) { flat.Del(*records[i]); }));
+
+        // tree of about the same number of records: dotted Search, Clone, printing
+        size_t breadth = max<size_t>(4, size_t(cbrt(double(size))));
+        CZone tree = Tree({breadth, 3, 0.25, {4, 2, 1, 1, 1}});
+        vector<string> dotted;
+        for (size_t i = 0; i < queries; i++) {
+            dotted.push_back(m_names[m_random() % m_names.size()]);
+        }
+        const CZone &treeView = tree;
+        _report("Search dotted", m_records, _measure(queries, [&](size_t i) { treeView.Search(dotted[i]); }));
+        _report("Clone", m_records, _measure(1000, [&](size_t) { delete tree.Clone(); }));
+        _report("Clone+Add", m_records, _measure(1000, [&](size_t i) {
+            unique_ptr<CZone> copy(static_cast<CZone *>(tree.Clone()));
+            dynamic_cast<CZone &>(copy->Search("n0.n0")[0]).Add(CRecA("bench" + to_string(i), CIPv4("10.0.0.1")));
+        }));
+
+        int devNull = open("/dev/null", O_WRONLY);
+        COutputBuffer out(devNull);
+        _report("PrintTo", m_records, _measure(10, [&](size_t) {
+            tree.PrintTo(out);
+            out.Flush();
+        }));
+        _report("operator<<", m_records, _measure(10, [&](size_t) {
+            ostringstream oss;
+            oss << tree;
+        }));
+        close(devNull);
+    }
+};
+
+int main(int argc, char *argv[]) {
+    vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(stoul(argv[i]));
+    }
+    if (sizes.empty()) {
+        sizes = {1000, 10000, 100000};
+    }
+
+    cout << left << setw(14) << "operation" << right << setw(9) << "records" << setw(14) << "ops/s" << setw(11)
+         << "p50 ns" << setw(11) << "p99 ns" << setw(12) << "max ns" << setw(10) << "allocs" << endl;
+    CBenchmark benchmark;
+    for (size_t size : sizes) {
+        benchmark.Run(size);
+    }
+    return 0;
+}
@@ -1,37 +1,305 @@
 #ifndef __PROGTEST__
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include <unistd.h>
+
 #include "ipaddress.h"
 using namespace std;
 #endif /* __PROGTEST__ */
 
+/**
+ * @brief Writes DNS wire format (RFC 1035) into a caller provided buffer. Names are compressed against
+ * the names written before. Nothing is allocated: running out of space or an invalid name only marks
+ * the buffer as failed.
+ */
+class CWireBuffer {
+   public:
+    static const uint16_t CLASS_IN = 1;
+    static const size_t MAX_LABEL = 63;
+    static const size_t MAX_LABELS = 127;
+    static const size_t MAX_COMPRESSION = 64;
+
+   private:
+    uint8_t *m_data;
+    size_t m_capacity;
+    size_t m_size = 0;
+    uint32_t m_ttl;
+    bool m_failed = false;
+    // offsets of the names (suffixes included) written so far, targets for the compression pointers
+    array<uint16_t, MAX_COMPRESSION> m_names;
+    size_t m_nameCount = 0;
+
+    static uint8_t _lower(uint8_t c) {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+
+    // appends the labels of a dotted name, a trailing dot (absolute name) is ignored
+    bool _labels(string_view name, array<string_view, MAX_LABELS> &labels, size_t &count) const {
+        if (!name.empty() && name.back() == '.') {
+            name.remove_suffix(1);
+        }
+        while (!name.empty()) {
+            size_t dot = name.find('.');
+            string_view label = name.substr(0, dot);
+            if (label.empty() || label.size() > MAX_LABEL || count == MAX_LABELS) {
+                return false;
+            }
+            labels[count++] = label;
+            name.remove_prefix(dot == string_view::npos ? name.size() : dot + 1);
+        }
+        return true;
+    }
+
+    // whether the name written at offset consists of exactly the given labels (case insensitive)
+    bool _matches(size_t offset, const string_view *labels, size_t count) const {
+        for (size_t i = 0;; i++) {
+            // our pointers always lead back to an earlier, complete name
+            while ((m_data[offset] & 0xC0) == 0xC0) {
+                offset = (m_data[offset] & 0x3F) << 8 | m_data[offset + 1];
+            }
+            size_t len = m_data[offset];
+            if (len == 0 || i == count) {
+                return len == 0 && i == count;
+            }
+            if (labels[i].size() != len) {
+                return false;
+            }
+            for (size_t j = 0; j < len; j++) {
+                if (_lower(m_data[offset + 1 + j]) != _lower(labels[i][j])) {
+                    return false;
+                }
+            }
+            offset += len + 1;
+        }
+    }
+
+   public:
+    CWireBuffer(uint8_t *data, size_t capacity, uint32_t ttl = 3600) : m_data(data), m_capacity(capacity), m_ttl(ttl) {}
+
+    size_t Size() const { return m_size; }
+    bool Failed() const { return m_failed; }
+    const uint8_t *Data() const { return m_data; }
+
+    // starts over, the buffer can be reused for the next message
+    void Clear() {
+        m_size = 0;
+        m_failed = false;
+        m_nameCount = 0;
+    }
+
+    void Bytes(const uint8_t *data, size_t size) {
+        if (m_failed || m_capacity - m_size < size) {
+            m_failed = true;
+            return;
+        }
+        copy(data, data + size, m_data + m_size);
+        m_size += size;
+    }
+
+    void U8(uint8_t value) {
+        Bytes(&value, 1);
+    }
+
+    void U16(uint16_t value) {
+        const uint8_t bytes[] = {uint8_t(value >> 8), uint8_t(value)};
+        Bytes(bytes, sizeof(bytes));
+    }
+
+    void U32(uint32_t value) {
+        U16(uint16_t(value >> 16));
+        U16(uint16_t(value));
+    }
+
+    // <character-string>, a length byte followed by at most 255 bytes
+    void CharString(string_view text) {
+        if (text.size() > 255) {
+            m_failed = true;
+            return;
+        }
+        U8(uint8_t(text.size()));
+        Bytes(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+    }
+
+    /**
+     * @brief Writes the name followed by the origin (both dotted), compressed where possible
+     * @param name Relative or absolute (trailing dot) name
+     * @param origin Suffix appended to the name, ignored for absolute names
+     */
+    void Name(string_view name, string_view origin = "") {
+        array<string_view, MAX_LABELS> labels;
+        size_t count = 0;
+        bool absolute = !name.empty() && name.back() == '.';
+        if (!_labels(name, labels, count) || (!absolute && !_labels(origin, labels, count))) {
+            m_failed = true;
+        }
+
+        for (size_t i = 0; i < count && !m_failed; i++) {
+            for (size_t j = 0; j < m_nameCount; j++) {
+                if (_matches(m_names[j], &labels[i], count - i)) {
+                    U16(0xC000 | m_names[j]);
+                    return;
+                }
+            }
+            if (m_size < 0x4000 && m_nameCount < MAX_COMPRESSION) {
+                m_names[m_nameCount++] = uint16_t(m_size);
+            }
+            CharString(labels[i]);
+        }
+        U8(0);
+    }
+
+    // owner name, type, class and TTL (the buffer's one for 0) of a resource record, returns the mark for EndRecord()
+    size_t BeginRecord(string_view name, string_view origin, uint16_t type, uint32_t ttl = 0) {
+        Name(name, origin);
+        U16(type);
+        U16(CLASS_IN);
+        U32(ttl != 0 ? ttl : m_ttl);
+        U16(0);
+        return m_size;
+    }
+
+    // fills in RDLENGTH once RDATA is written
+    void EndRecord(size_t mark) {
+        if (m_failed) {
+            return;
+        }
+        size_t length = m_size - mark;
+        m_data[mark - 2] = uint8_t(length >> 8);
+        m_data[mark - 1] = uint8_t(length);
+    }
+};
+
+/**
+ * @brief Reusable text output buffer, handed over to a file descriptor or a stream whenever it fills up
+ * (and on Flush / destruction). Writing into it does not allocate.
+ */
+class COutputBuffer {
+   public:
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+    // the longest piece written through Reserve(), an IPv6 address
+    static constexpr size_t MIN_CAPACITY = 64;
+
+   private:
+    vector<char> m_data;
+    size_t m_size = 0;
+    int m_fd = -1;
+    ostream *m_os = nullptr;
+    bool m_failed = false;
+
+   public:
+    COutputBuffer(int fd, size_t capacity = DEFAULT_CAPACITY) : m_data(max(capacity, MIN_CAPACITY)), m_fd(fd) {}
+    COutputBuffer(ostream &os, size_t capacity = DEFAULT_CAPACITY) : m_data(max(capacity, MIN_CAPACITY)), m_os(&os) {}
+    COutputBuffer(const COutputBuffer &) = delete;
+    COutputBuffer &operator=(const COutputBuffer &) = delete;
+    ~COutputBuffer() { Flush(); }
+
+    bool Failed() const { return m_failed; }
+
+    bool Flush() {
+        if (m_os != nullptr) {
+            m_failed |= !m_os->write(m_data.data(), m_size);
+        } else {
+            for (size_t done = 0; done < m_size && !m_failed;) {
+                ssize_t written = ::write(m_fd, m_data.data() + done, m_size - done);
+                if (written >= 0) {
+                    done += written;
+                } else if (errno != EINTR) {
+                    m_failed = true;
+                }
+            }
+        }
+        m_size = 0;
+        return !m_failed;
+    }
+
+    void Write(string_view text) {
+        while (!text.empty()) {
+            if (m_size == m_data.size()) {
+                Flush();
+            }
+            size_t chunk = min(text.size(), m_data.size() - m_size);
+            copy(text.begin(), text.begin() + chunk, m_data.begin() + m_size);
+            m_size += chunk;
+            text.remove_prefix(chunk);
+        }
+    }
+
+    void Put(char c) {
+        if (m_size == m_data.size()) {
+            Flush();
+        }
+        m_data[m_size++] = c;
+    }
+
+    // room for at least size (<= MIN_CAPACITY) characters, written in the to_chars fashion and then
+    // confirmed by Commit() with the end of the written characters
+    char *Reserve(size_t size) {
+        if (m_data.size() - m_size < size) {
+            Flush();
+        }
+        return m_data.data() + m_size;
+    }
+
+    void Commit(const char *end) {
+        m_size = end - m_data.data();
+    }
+
+    char *End() {
+        return m_data.data() + m_data.size();
+    }
+};
+
 class CRecord {
    private:
     string m_name;
     string m_type;
+    // seconds, 0 for records that never expire
+    uint32_t m_ttl = 0;
+
+   protected:
+    // the wire form under the given owner name, see SerializeWire
+    virtual bool _serializeWire(CWireBuffer & /* buffer */, string_view /* owner */, string_view /* origin */) const {
+        return false;
+    }
 
    public:
     CRecord() = delete;
     CRecord(const string &name, const string &type) : m_name(name), m_type(type) {}
     virtual ~CRecord() = default;
 
+    uint32_t TTL() const { return m_ttl; }
+
+    // the record expires ttl seconds after it is added to a zone, see CZone::Expire
+    CRecord &SetTTL(uint32_t ttl) {
+        m_ttl = ttl;
+        return *this;
+    }
+
     virtual CRecord *Clone() const {
         return new CRecord(*this);
     }
@@ -56,6 +324,24 @@ class CRecord {
         return os;
     }
 
+    // same as Print(os, "", true) without the stream
+    virtual void PrintTo(COutputBuffer &out) const {
+        out.Write(Name());
+        out.Put(' ');
+        out.Write(Type());
+    }
+
+    /**
+     * @brief Writes the record as a DNS resource record
+     * @param buffer Output, check its Failed() afterwards
+     * @param origin Dotted name of the zone the record is in, appended to the owner name
+     * @param owner Owner name to answer under instead of the record name (a name matched by a wildcard)
+     * @return bool false if the record has no wire form (zones), nothing is written then
+     */
+    bool SerializeWire(CWireBuffer &buffer, string_view origin, string_view owner = "") const {
+        return _serializeWire(buffer, owner.empty() ? string_view(Name()) : owner, origin);
+    }
+
     /**
      * @brief Wrapper for displaying the class in a string format
      * @param os Stream
@@ -69,7 +355,12 @@ class CRecord {
 
 class CSearchResult {
    private:
-    vector<shared_ptr<CRecord>> m_data;
+    vector<shared_ptr<const CRecord>> m_data;
+    // the records made private to a modifiable zone for the result, the others are shared with copies of the
+    // zone and published snapshots, so they are cloned before being handed out for modification
+    vector<char> m_owned;
+    // the names matched by wildcard records, the records answer under them (empty for the other records)
+    vector<string> m_owners;
 
    public:
     CSearchResult() = default;
@@ -88,12 +379,45 @@ class CSearchResult {
         // if (index >= Count()) {
         //     throw std::out_of_range("Index is out of range - index >= Count()");
         // }
-        return *m_data.at(index);
+        shared_ptr<const CRecord> &rec = m_data.at(index);
+        if (!m_owned[index]) {
+            rec = shared_ptr<const CRecord>(rec->Clone());
+            m_owned[index] = true;
+        }
+        // either a clone or a record the zone gave up for modification, never a const object
+        return const_cast<CRecord &>(*rec);
     }
 
-    void Add(shared_ptr<CRecord> rec) {
+    void Add(shared_ptr<const CRecord> rec, const string &owner = "") {
         // m_data.push_back(shared_ptr<CRecord>(rec->Clone()));
         m_data.push_back(rec);
+        m_owned.push_back(false);
+        m_owners.push_back(owner);
+    }
+
+    // a record the zone made private for the result, changes made through the result reach the zone
+    void AddOwned(shared_ptr<CRecord> rec, const string &owner = "") {
+        m_data.push_back(rec);
+        m_owned.push_back(true);
+        m_owners.push_back(owner);
+    }
+
+    const vector<shared_ptr<const CRecord>> &Data() const {
+        return m_data;
+    }
+
+    // parallel to Data(), the queried name for records matched by a wildcard, empty for the others
+    const vector<string> &Owners() const {
+        return m_owners;
+    }
+
+    // writes the records as an answer section, returns how many were written (ANCOUNT)
+    int SerializeWire(CWireBuffer &buffer, string_view origin = "") const {
+        int count = 0;
+        for (size_t i = 0; i < m_data.size(); i++) {
+            count += m_data[i]->SerializeWire(buffer, origin, m_owners[i]);
+        }
+        return count;
     }
 
     friend ostream &operator<<(ostream &os, const CSearchResult &s) {
@@ -133,6 +457,21 @@ class CRecA : public CRecord {
     ostream &Print(ostream &os, const string &padding, bool isLast) const override {
         return os << Name() << " " << Type() << " " << IPv4();
     }
+
+    void PrintTo(COutputBuffer &out) const override {
+        CRecord::PrintTo(out);
+        out.Put(' ');
+        out.Commit(IPv4().ToChars(out.Reserve(CIPv4::MAX_CHARS), out.End()).ptr);
+    }
+
+   protected:
+    bool _serializeWire(CWireBuffer &buffer, string_view owner, string_view origin) const override {
+        size_t mark = buffer.BeginRecord(owner, origin, 1, TTL());
+        const auto octets = IPv4().Octets();
+        buffer.Bytes(octets.data(), octets.size());
+        buffer.EndRecord(mark);
+        return true;
+    }
 };
 
 class CRecAAAA : public CRecord {
@@ -153,192 +492,1293 @@ class CRecAAAA : public CRecord {
         if (rec == nullptr) {
             return CRecord::isEqual(other);
         }
-        return (CRecord::isEqual(other) && IPv6() == rec->IPv6());
+        return (CRecord::isEqual(other) && IPv6() == rec->IPv6());
+    }
+
+    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
+        return os << Name() << " " << Type() << " " << IPv6();
+    }
+
+    void PrintTo(COutputBuffer &out) const override {
+        CRecord::PrintTo(out);
+        out.Put(' ');
+        out.Commit(IPv6().ToChars(out.Reserve(CIPv6::MAX_CHARS), out.End()).ptr);
+    }
+
+   protected:
+    bool _serializeWire(CWireBuffer &buffer, string_view owner, string_view origin) const override {
+        size_t mark = buffer.BeginRecord(owner, origin, 28, TTL());
+        const auto octets = IPv6().Octets();
+        buffer.Bytes(octets.data(), octets.size());
+        buffer.EndRecord(mark);
+        return true;
+    }
+};
+
+class CRecMX : public CRecord {
+   private:
+    string m_serverName;
+    int m_priority;
+
+   public:
+    CRecMX() = delete;
+    CRecMX(const string &name, const string &serverName, int priority) : CRecord(name, "MX"), m_serverName(serverName), m_priority(priority) {}
+    CRecord *Clone() const override {
+        return new CRecMX(*this);
+    }
+
+    int Priority() const { return m_priority; }
+    const string &ServerName() const { return m_serverName; }
+
+    bool isEqual(const CRecord &other) const override {
+        const CRecMX *rec = dynamic_cast<const CRecMX *>(&other);
+        if (rec == nullptr) {
+            return CRecord::isEqual(other);
+        }
+        return (CRecord::isEqual(other) && ServerName() == rec->ServerName() && Priority() == rec->Priority());
+    }
+
+    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
+        return os << Name() << " " << Type() << " " << Priority() << " " << ServerName();
+    }
+
+    void PrintTo(COutputBuffer &out) const override {
+        CRecord::PrintTo(out);
+        out.Put(' ');
+        out.Commit(to_chars(out.Reserve(16), out.End(), Priority()).ptr);
+        out.Put(' ');
+        out.Write(ServerName());
+    }
+
+   protected:
+    bool _serializeWire(CWireBuffer &buffer, string_view owner, string_view origin) const override {
+        size_t mark = buffer.BeginRecord(owner, origin, 15, TTL());
+        buffer.U16(uint16_t(Priority()));
+        buffer.Name(ServerName(), origin);
+        buffer.EndRecord(mark);
+        return true;
+    }
+};
+
+class CRecCNAME : public CRecord {
+   private:
+    string m_refName;
+
+   public:
+    CRecCNAME() = delete;
+    CRecCNAME(const string &name, const string &referenceName) : CRecord(name, "CNAME"), m_refName(referenceName) {}
+    CRecord *Clone() const override {
+        return new CRecCNAME(*this);
+    }
+
+    const string &Reference() const { return m_refName; }
+
+    bool isEqual(const CRecord &other) const override {
+        // check just the name since there can't be the same name for a CName and any other record
+        return other.Name() == Name();
+    }
+
+    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
+        return os << Name() << " " << Type() << " " << Reference();
+    }
+
+    void PrintTo(COutputBuffer &out) const override {
+        CRecord::PrintTo(out);
+        out.Put(' ');
+        out.Write(Reference());
+    }
+
+   protected:
+    bool _serializeWire(CWireBuffer &buffer, string_view owner, string_view origin) const override {
+        size_t mark = buffer.BeginRecord(owner, origin, 5, TTL());
+        buffer.Name(Reference(), origin);
+        buffer.EndRecord(mark);
+        return true;
+    }
+};
+
+class CRecSPF : public CRecord {
+   public:
+    // qualifier returned by Evaluate when no mechanism matches
+    static const char NO_MATCH = '\0';
+    // returned by Evaluate when a mechanism needing a DNS lookup comes before any match
+    static const char NEEDS_LOOKUP = '\1';
+
+   private:
+    enum EKind : uint8_t { IP4_TABLE, IP6, ALL, INCLUDE, A, MX, UNKNOWN };
+
+    // compiled mechanism, what first and last refer to depends on the kind: a range of m_ranges (IP4_TABLE),
+    // an index to m_ipv6 (IP6) or the domain in m_text (INCLUDE, A, MX)
+    struct CMechanism {
+        EKind kind;
+        char qualifier;
+        uint8_t prefixLen;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    // the mechanisms as given, one after another, m_ends[i] is where the i-th one ends
+    string m_text;
+    vector<uint32_t> m_ends;
+    vector<CMechanism> m_mechanisms;
+    // consecutive ip4 mechanisms of the same qualifier share one table of sorted, disjoint, inclusive ranges
+    vector<pair<uint32_t, uint32_t>> m_ranges;
+    vector<array<uint8_t, 16>> m_ipv6;
+
+    string_view _text(size_t index) const {
+        size_t start = index == 0 ? 0 : m_ends[index - 1];
+        return string_view(m_text).substr(start, m_ends[index] - start);
+    }
+
+    // "/len" at the end of the mechanism, the whole address if it's missing
+    static bool _prefix(const char *first, const char *last, int maxLen, uint8_t &prefixLen) {
+        if (first == last) {
+            prefixLen = maxLen;
+            return true;
+        }
+        int value = -1;
+        if (*first != '/' || from_chars(first + 1, last, value).ptr != last || value < 0 || value > maxLen) {
+            return false;
+        }
+        prefixLen = value;
+        return true;
+    }
+
+    // merges the range into the ip4 table, which is always the last mechanism (its ranges the tail of m_ranges)
+    void _addRange(CMechanism &table, uint32_t low, uint32_t high) {
+        auto begin = m_ranges.begin() + table.first;
+        auto it = upper_bound(begin, m_ranges.end(), low, [](uint32_t value, const pair<uint32_t, uint32_t> &range) {
+            return value < range.first;
+        });
+        if (it != begin && uint64_t(prev(it)->second) + 1 >= low) {
+            --it;
+            it->second = max(it->second, high);
+        } else {
+            it = m_ranges.insert(it, {low, high});
+        }
+        auto absorbed = next(it);
+        while (absorbed != m_ranges.end() && uint64_t(it->second) + 1 >= absorbed->first) {
+            it->second = max(it->second, absorbed->second);
+            ++absorbed;
+        }
+        m_ranges.erase(next(it), absorbed);
+        table.last = m_ranges.size();
+    }
+
+    void _compile(string_view text) {
+        CMechanism mechanism{UNKNOWN, '+', 0, 0, 0};
+        if (!text.empty() && (text[0] == '+' || text[0] == '-' || text[0] == '~' || text[0] == '?')) {
+            mechanism.qualifier = text[0];
+            text.remove_prefix(1);
+        }
+        const char *last = text.data() + text.size();
+        size_t textStart = m_text.size() - text.size();
+        auto domain = [&mechanism, &text, textStart](EKind kind, size_t skip) {
+            mechanism.kind = kind;
+            mechanism.first = textStart + min(skip, text.size());
+            mechanism.last = textStart + text.size();
+        };
+
+        if (text.substr(0, 4) == "ip4:") {
+            CIPv4 addr;
+            auto parsed = CIPv4::FromChars(text.data() + 4, last, addr);
+            if (parsed.ec != errc() || !_prefix(parsed.ptr, last, 32, mechanism.prefixLen)) {
+                m_mechanisms.push_back(mechanism);
+                return;
+            }
+            uint32_t value = addr.Value();
+            uint32_t hostMask = mechanism.prefixLen == 0 ? ~0u : (1u << (32 - mechanism.prefixLen)) - 1;
+            if (m_mechanisms.empty() || m_mechanisms.back().kind != IP4_TABLE || m_mechanisms.back().qualifier != mechanism.qualifier) {
+                mechanism.kind = IP4_TABLE;
+                mechanism.first = mechanism.last = m_ranges.size();
+                m_mechanisms.push_back(mechanism);
+            }
+            _addRange(m_mechanisms.back(), value & ~hostMask, value | hostMask);
+        } else if (text.substr(0, 4) == "ip6:") {
+            CIPv6 addr;
+            auto parsed = CIPv6::FromChars(text.data() + 4, last, addr);
+            if (parsed.ec == errc() && _prefix(parsed.ptr, last, 128, mechanism.prefixLen)) {
+                mechanism.kind = IP6;
+                mechanism.first = m_ipv6.size();
+                m_ipv6.push_back(addr.Octets());
+            }
+            m_mechanisms.push_back(mechanism);
+        } else if (text == "all") {
+            mechanism.kind = ALL;
+            m_mechanisms.push_back(mechanism);
+        } else if (text.substr(0, 8) == "include:") {
+            domain(INCLUDE, 8);
+            m_mechanisms.push_back(mechanism);
+        } else if (text == "a" || text.substr(0, 2) == "a:" || text.substr(0, 2) == "a/") {
+            domain(A, 2);
+            m_mechanisms.push_back(mechanism);
+        } else if (text == "mx" || text.substr(0, 3) == "mx:" || text.substr(0, 3) == "mx/") {
+            domain(MX, 3);
+            m_mechanisms.push_back(mechanism);
+        } else {
+            m_mechanisms.push_back(mechanism);
+        }
+    }
+
+   public:
+    CRecSPF() = delete;
+    CRecSPF(const string &name) : CRecord(name, "SPF") {}
+    CRecord *Clone() const override {
+        return new CRecSPF(*this);
+    }
+
+    CRecSPF &Add(const string &address) {
+        m_text += address;
+        m_ends.push_back(m_text.size());
+        _compile(string_view(m_text).substr(m_text.size() - address.size()));
+        return *this;
+    }
+
+    /**
+     * @brief Evaluates the ip4, ip6 and all mechanisms in order, without any string work. The unknown
+     * ones are skipped, the ones that need DNS lookups (include, a, mx) stop the evaluation, as the
+     * mechanisms after them only count if they do not match.
+     * @param addr Address of the sender
+     * @return char Qualifier ('+', '-', '~', '?') of the first matching mechanism, NEEDS_LOOKUP if
+     * a mechanism needing a lookup comes before it, NO_MATCH if none matches
+     */
+    char Evaluate(const CIPv4 &addr) const {
+        uint32_t value = addr.Value();
+        for (const auto &it : m_mechanisms) {
+            if (it.kind == ALL) {
+                return it.qualifier;
+            }
+            if (it.kind == INCLUDE || it.kind == A || it.kind == MX) {
+                return NEEDS_LOOKUP;
+            }
+            if (it.kind != IP4_TABLE) {
+                continue;
+            }
+            auto end = m_ranges.begin() + it.last;
+            auto found = upper_bound(m_ranges.begin() + it.first, end, value, [](uint32_t v, const pair<uint32_t, uint32_t> &range) {
+                return v < range.first;
+            });
+            if (found != m_ranges.begin() + it.first && prev(found)->second >= value) {
+                return it.qualifier;
+            }
+        }
+        return NO_MATCH;
+    }
+
+    char Evaluate(const CIPv6 &addr) const {
+        auto octets = addr.Octets();
+        for (const auto &it : m_mechanisms) {
+            if (it.kind == ALL) {
+                return it.qualifier;
+            }
+            if (it.kind == INCLUDE || it.kind == A || it.kind == MX) {
+                return NEEDS_LOOKUP;
+            }
+            if (it.kind != IP6) {
+                continue;
+            }
+            const auto &network = m_ipv6[it.first];
+            int bytes = it.prefixLen / 8, bits = it.prefixLen % 8;
+            if (equal(octets.begin(), octets.begin() + bytes, network.begin()) &&
+                (bits == 0 || ((octets[bytes] ^ network[bytes]) & (0xff << (8 - bits)) & 0xff) == 0)) {
+                return it.qualifier;
+            }
+        }
+        return NO_MATCH;
+    }
+
+    // the sender passes (the first matching mechanism has the '+' qualifier)
+    bool Matches(const CIPv4 &addr) const { return Evaluate(addr) == '+'; }
+    bool Matches(const CIPv6 &addr) const { return Evaluate(addr) == '+'; }
+
+    // domains of the include mechanisms, to be evaluated by the caller
+    vector<string_view> Includes() const {
+        vector<string_view> result;
+        for (const auto &it : m_mechanisms) {
+            if (it.kind == INCLUDE) {
+                result.push_back(string_view(m_text).substr(it.first, it.last - it.first));
+            }
+        }
+        return result;
+    }
+
+    bool isEqual(const CRecord &other) const override {
+        return CRecord::isEqual(other);
+    }
+
+    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
+        os << Name() << " " << Type();
+        for (size_t i = 0; i < m_ends.size(); i++) {
+            if (_text(i) != _text(0)) {
+                os << ",";
+            }
+            os << " " << _text(i);
+        }
+        return os;
+    }
+
+    void PrintTo(COutputBuffer &out) const override {
+        CRecord::PrintTo(out);
+        for (size_t i = 0; i < m_ends.size(); i++) {
+            if (_text(i) != _text(0)) {
+                out.Put(',');
+            }
+            out.Put(' ');
+            out.Write(_text(i));
+        }
+    }
+
+   protected:
+    // the text "v=spf1 <mechanism> ...", cut into <character-string>s of at most 255 bytes that the
+    // receivers join without any separator (RFC 7208 3.3)
+    bool _serializeWire(CWireBuffer &buffer, string_view owner, string_view origin) const override {
+        static constexpr string_view VERSION = "v=spf1";
+        size_t mark = buffer.BeginRecord(owner, origin, 99, TTL());
+        // one space before every mechanism
+        size_t length = VERSION.size() + m_ends.size() + m_text.size();
+        size_t left = 0;
+        auto put = [&buffer, &length, &left](string_view piece) {
+            while (!piece.empty()) {
+                if (left == 0) {
+                    left = min<size_t>(length, 255);
+                    length -= left;
+                    buffer.U8(uint8_t(left));
+                }
+                size_t size = min(left, piece.size());
+                buffer.Bytes(reinterpret_cast<const uint8_t *>(piece.data()), size);
+                piece.remove_prefix(size);
+                left -= size;
+            }
+        };
+        put(VERSION);
+        for (size_t i = 0; i < m_ends.size(); i++) {
+            put(" ");
+            put(_text(i));
+        }
+        buffer.EndRecord(mark);
+        return true;
+    }
+};
+
+/**
+ * @brief Path compressed binary trie (Patricia trie) over the bits of an N byte address.
+ * Leaves hold the records pointing at exactly that address, inner nodes always have both children.
+ */
+template <size_t N>
+class CAddrTrie {
+   public:
+    using Key = array<uint8_t, N>;
+    static constexpr int KEY_BITS = N * 8;
+
+   private:
+    struct CNode {
+        Key key;
+        int bits;  // how many leading bits of key are significant, KEY_BITS for leaves
+        vector<shared_ptr<CRecord>> records;
+        unique_ptr<CNode> child[2];
+    };
+    unique_ptr<CNode> m_root;
+
+    static int _bit(const Key &key, int pos) {
+        return (key[pos / 8] >> (7 - pos % 8)) & 1;
+    }
+
+    // length of the common prefix of both keys, capped at limit
+    static int _commonBits(const Key &a, const Key &b, int limit) {
+        for (int i = 0; i < limit; i += 8) {
+            uint8_t diff = a[i / 8] ^ b[i / 8];
+            if (diff != 0) {
+                int pos = i;
+                while (!(diff & 0x80)) {
+                    diff <<= 1;
+                    pos++;
+                }
+                return min(pos, limit);
+            }
+        }
+        return limit;
+    }
+
+    static unique_ptr<CNode> _copy(const unique_ptr<CNode> &node) {
+        if (!node) {
+            return nullptr;
+        }
+        unique_ptr<CNode> res(new CNode{node->key, node->bits, node->records, {}});
+        res->child[0] = _copy(node->child[0]);
+        res->child[1] = _copy(node->child[1]);
+        return res;
+    }
+
+    template <typename F>
+    static void _collect(const CNode &node, F &&callback) {
+        if (node.bits == KEY_BITS) {
+            for (const auto &it : node.records) {
+                callback(it);
+            }
+            return;
+        }
+        _collect(*node.child[0], callback);
+        _collect(*node.child[1], callback);
+    }
+
+   public:
+    CAddrTrie() = default;
+    CAddrTrie(const CAddrTrie &other) : m_root(_copy(other.m_root)) {}
+    CAddrTrie &operator=(const CAddrTrie &other) {
+        if (this != &other) {
+            m_root = _copy(other.m_root);
+        }
+        return *this;
+    }
+
+    void Insert(const Key &key, const shared_ptr<CRecord> &rec) {
+        unique_ptr<CNode> *slot = &m_root;
+        while (*slot) {
+            CNode &node = **slot;
+            int common = _commonBits(node.key, key, node.bits);
+            if (common < node.bits) {
+                // the key leaves the compressed path in the middle, split it there
+                unique_ptr<CNode> split(new CNode{key, common, {}, {}});
+                int dir = _bit(key, common);
+                split->child[!dir] = move(*slot);
+                split->child[dir].reset(new CNode{key, KEY_BITS, {rec}, {}});
+                *slot = move(split);
+                return;
+            }
+            if (node.bits == KEY_BITS) {
+                node.records.push_back(rec);
+                return;
+            }
+            slot = &node.child[_bit(key, node.bits)];
+        }
+        slot->reset(new CNode{key, KEY_BITS, {rec}, {}});
+    }
+
+    void Remove(const Key &key, const shared_ptr<CRecord> &rec) {
+        unique_ptr<CNode> *parent = nullptr;
+        unique_ptr<CNode> *slot = &m_root;
+        while (*slot && (*slot)->bits < KEY_BITS) {
+            parent = slot;
+            slot = &(*slot)->child[_bit(key, (*slot)->bits)];
+        }
+        if (!*slot || (*slot)->key != key) {
+            return;
+        }
+
+        vector<shared_ptr<CRecord>> &records = (*slot)->records;
+        records.erase(remove(records.begin(), records.end(), rec), records.end());
+        if (!records.empty()) {
+            return;
+        }
+
+        slot->reset();
+        if (parent != nullptr) {
+            // an inner node with a single child is useless, pull the sibling up
+            unique_ptr<CNode> sibling = move((*parent)->child[0] ? (*parent)->child[0] : (*parent)->child[1]);
+            *parent = move(sibling);
+        }
+    }
+
+    // puts other in place of rec, the records of the address keep their order
+    void Replace(const Key &key, const shared_ptr<CRecord> &rec, const shared_ptr<CRecord> &other) {
+        CNode *node = m_root.get();
+        while (node != nullptr && node->bits < KEY_BITS) {
+            node = node->child[_bit(key, node->bits)].get();
+        }
+        if (node != nullptr && node->key == key) {
+            replace(node->records.begin(), node->records.end(), rec, other);
+        }
+    }
+
+    template <typename F>
+    void Find(const Key &key, F &&callback) const {
+        Find(key, KEY_BITS, callback);
+    }
+
+    // calls callback for every record whose address shares the first prefixLen bits with key
+    template <typename F>
+    void Find(const Key &key, int prefixLen, F &&callback) const {
+        const CNode *node = m_root.get();
+        while (node != nullptr && node->bits < prefixLen) {
+            if (_commonBits(node->key, key, node->bits) < node->bits) {
+                return;
+            }
+            node = node->child[_bit(key, node->bits)].get();
+        }
+        if (node != nullptr && _commonBits(node->key, key, prefixLen) == prefixLen) {
+            _collect(*node, callback);
+        }
+    }
+};
+
+/**
+ * @brief Hierarchical timing wheel (LEVELS wheels of SLOTS slots, each level SLOTS times coarser than
+ * the one below) of record expirations. Insert is O(1), a timer is moved down at most LEVELS times
+ * before it fires, so expiring is O(1) amortized per timer. Deadlines are absolute, the clock of the
+ * wheel only has to move when a timer is due (see Next).
+ */
+class CExpiryWheel {
+   public:
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+    static const int LEVELS = 6;
+
+   private:
+    struct CTimer {
+        uint64_t deadline;
+        shared_ptr<CRecord> rec;
+    };
+
+    uint64_t m_now = 0;
+    size_t m_count = 0;
+    // the earliest deadline of the timers
+    uint64_t m_next = UINT64_MAX;
+    array<size_t, LEVELS> m_levelCount{};
+    // LEVELS * SLOTS slots, allocated with the first timer
+    vector<vector<CTimer>> m_slots;
+
+    // the timer goes to the lowest level whose slots (together with the levels above) tell it from now
+    void _place(CTimer &&timer) {
+        int level = 0;
+        while (level < LEVELS - 1 && (timer.deadline >> (SLOT_BITS * (level + 1))) != (m_now >> (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        size_t slot = (timer.deadline >> (SLOT_BITS * level)) & (SLOTS - 1);
+        m_slots[level * SLOTS + slot].push_back(move(timer));
+        m_levelCount[level]++;
+    }
+
+    // a level below the top one only holds deadlines after the clock in its current span, so the first
+    // non-empty slot after the clock has the earliest ones; the top level can wrap around
+    uint64_t _earliest() const {
+        if (m_count == 0) {
+            return UINT64_MAX;
+        }
+        int level = 0;
+        while (m_levelCount[level] == 0) {
+            level++;
+        }
+        size_t first = level == LEVELS - 1 ? 0 : ((m_now >> (SLOT_BITS * level)) & (SLOTS - 1)) + 1;
+        uint64_t earliest = UINT64_MAX;
+        for (size_t slot = first; slot < SLOTS && (earliest == UINT64_MAX || level == LEVELS - 1); slot++) {
+            for (const auto &it : m_slots[level * SLOTS + slot]) {
+                earliest = min(earliest, it.deadline);
+            }
+        }
+        return earliest;
+    }
+
+   public:
+    size_t Size() const { return m_count; }
+    uint64_t Next() const { return m_next; }
+
+    void Insert(uint64_t deadline, const shared_ptr<CRecord> &rec) {
+        if (m_slots.empty()) {
+            m_slots.resize(LEVELS * SLOTS);
+        }
+        deadline = max(deadline, m_now + 1);
+        m_next = min(m_next, deadline);
+        _place({deadline, rec});
+        m_count++;
+    }
+
+    // moves all the deadlines by delta seconds (not below 0)
+    void Shift(int64_t delta) {
+        auto shift = [delta](uint64_t time) {
+            return delta < 0 && time < uint64_t(-delta) ? 0 : time + delta;
+        };
+        CExpiryWheel shifted;
+        shifted.m_now = shift(m_now);
+        for (const auto &slot : m_slots) {
+            for (const auto &it : slot) {
+                shifted.Insert(shift(it.deadline), it.rec);
+            }
+        }
+        *this = move(shifted);
+    }
+
+    /**
+     * @brief Moves the clock to now, firing the timers with a deadline up to now (in deadline order)
+     * @param now Seconds, a clock going back is ignored
+     * @param fire Called with the record of every expired timer
+     */
+    template <typename TFire>
+    void Advance(uint64_t now, TFire &&fire) {
+        while (m_now < now) {
+            if (m_count == 0) {
+                m_now = now;
+                break;
+            }
+            // nothing happens until the clock enters the next slot of the lowest level with timers
+            int lowest = 0;
+            while (m_levelCount[lowest] == 0) {
+                lowest++;
+            }
+            uint64_t next = ((m_now >> (SLOT_BITS * lowest)) + 1) << (SLOT_BITS * lowest);
+            if (next > now) {
+                m_now = now;
+                break;
+            }
+            m_now = next;
+            // the coarser slots the clock just entered are spread over the finer levels, the highest first
+            for (int level = LEVELS - 1; level > 0; level--) {
+                if ((m_now & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                    continue;
+                }
+                vector<CTimer> cascade;
+                cascade.swap(m_slots[level * SLOTS + ((m_now >> (SLOT_BITS * level)) & (SLOTS - 1))]);
+                m_levelCount[level] -= cascade.size();
+                for (auto &it : cascade) {
+                    _place(move(it));
+                }
+            }
+            vector<CTimer> due;
+            due.swap(m_slots[m_now & (SLOTS - 1)]);
+            m_levelCount[0] -= due.size();
+            for (auto &it : due) {
+                m_count--;
+                fire(it.rec);
+            }
+        }
+        m_next = _earliest();
+    }
+};
+
+/**
+ * @brief MX records of one name ordered by priority, see CZone::SelectMX. Records of the same priority
+ * are rotated by the seed, so that each of them comes first equally often. The view keeps the records
+ * it was made with alive, later changes of the zone do not show up in it.
+ */
+class CMXView {
+   public:
+    struct CEntry {
+        shared_ptr<CRecMX> rec;
+        // the records of the same priority, [groupBegin, groupEnd)
+        uint32_t groupBegin;
+        uint32_t groupEnd;
+    };
+
+   private:
+    // points into the zone contents, which it shares
+    shared_ptr<const vector<CEntry>> m_entries;
+    size_t m_seed = 0;
+
+   public:
+    CMXView() = default;
+    CMXView(shared_ptr<const vector<CEntry>> entries, size_t seed) : m_entries(move(entries)), m_seed(seed) {}
+
+    int Count() const { return m_entries == nullptr ? 0 : m_entries->size(); }
+
+    const CRecMX &operator[](int index) const {
+        if (index < 0 || index >= Count()) {
+            throw out_of_range("Index is out of range");
+        }
+        const CEntry &entry = (*m_entries)[index];
+        size_t size = entry.groupEnd - entry.groupBegin;
+        return *(*m_entries)[entry.groupBegin + (index - entry.groupBegin + m_seed) % size].rec;
+    }
+};
+
+/**
+ * @brief Net change of a zone between two of its versions (IXFR style), see CZone::Diff
+ */
+struct CZoneDiff {
+    size_t from = 0;
+    size_t to = 0;
+    vector<shared_ptr<CRecord>> removed;
+    vector<shared_ptr<CRecord>> added;
+};
+
+class CZone : public CRecord {
+   public:
+    static const int MAX_CNAME_HOPS = 16;
+    static const size_t MAX_RESOLVE_MEMO = 4096;
+    // Add/Del operations remembered for Diff, older versions need a full transfer
+    static const size_t MAX_JOURNAL = 1024;
+    // record name matching any label nobody else in the zone has
+    inline static const string WILDCARD = "*";
+
+   private:
+    // Resolve() answers, valid only while the generation they were computed in lasts; Resolve is const
+    // and may be called by several threads at once, hence the lock
+    struct CResolveMemo {
+        mutex lock;
+        size_t generation = 0;
+        unordered_map<string, CSearchResult> entries;
+    };
+
+    // contents of a zone, shared by the zone copies (Clone, copy constructor, assignment) until
+    // one of them gets modified, see _detach()
+    struct CJournalEntry {
+        size_t version;
+        bool added;
+        shared_ptr<CRecord> rec;
+    };
+
+    // which records of the contents may be modified in place, a copy of the contents starts with none
+    struct COwnership {
+        // records (nested zones included) created for these contents, the others are shared with other copies
+        unordered_set<const CRecord *> records;
+        // set once the contents are shared by another zone, none of the records is private then
+        atomic<bool> lent{false};
+
+        COwnership() = default;
+        COwnership(const COwnership &) {}
+    };
+
+    struct CZoneData {
+        vector<shared_ptr<CRecord>> records;
+        // the same records bucketed by name, in insertion order
+        unordered_map<string, vector<shared_ptr<CRecord>>> byName;
+        vector<shared_ptr<CZone>> zones;
+        CAddrTrie<4> reverseIPv4;
+        CAddrTrie<16> reverseIPv6;
+        // bumped by every Add/Del of this zone (the nested zones have their own), journal holds the last ones
+        size_t version = 0;
+        deque<CJournalEntry> journal;
+        // MX records of each name, by priority (then in insertion order)
+        unordered_map<string, vector<CMXView::CEntry>> mxByName;
+        // the records with a TTL, removed records stay here until their time comes (and are skipped then)
+        CExpiryWheel expiry;
+        // records with a pending timer that were replaced by a private copy, see _own()
+        unordered_map<shared_ptr<CRecord>, shared_ptr<CRecord>> replaced;
+        COwnership ownership;
+    };
+
+    shared_ptr<CZoneData> m_data;
+    mutable CResolveMemo m_resolveMemo;
+    // bumped by every change of the zone tree, shared by the zone and the nested zones it handed out for
+    // modification (see _own), as those can be modified directly without their parents knowing
+    shared_ptr<atomic<size_t>> m_generation;
+    // seconds, the clock of the zone tree as of the last Expire, nested zones get it when they are reached
+    uint64_t m_now = 0;
+
+    static vector<string> _split(const string &recordName, char separator) {
+        vector<string> parts;
+        size_t start = 0;
+        for (size_t end; (end = recordName.find(separator, start)) != string::npos; start = end + 1) {
+            parts.push_back(recordName.substr(start, end - start));
+        }
+        // same as getline, a trailing separator does not produce an empty part
+        if (start < recordName.size() || parts.empty()) {
+            parts.push_back(recordName.substr(start));
+        }
+        return parts;
+    }
+
+    /**
+     * @brief Makes the contents of this zone (this level only) private before they are modified. The
+     * records, nested zones included, stay shared with the other copies, see _own().
+     */
+    void _detach() {
+        if (m_data.use_count() == 1) {
+            // the copies that shared the contents are gone, but they may still share the records
+            if (m_data->ownership.lent) {
+                m_data->ownership.records.clear();
+                m_data->ownership.lent = false;
+            }
+            return;
+        }
+        m_data->ownership.lent = true;
+        m_data = make_shared<CZoneData>(*m_data);
+    }
+
+    /**
+     * @brief The index-th record of the bucket, private to this zone (detached already), so that it can be
+     * modified in place. A record shared with other copies is replaced by a copy of its own first, for a
+     * nested zone that is O(1) as its contents stay shared until it gets modified.
+     */
+    shared_ptr<CRecord> _own(const string &bucketName, size_t index) {
+        shared_ptr<CRecord> rec = m_data->byName[bucketName][index];
+        if (m_data->ownership.records.count(rec.get()) == 0) {
+            shared_ptr<CRecord> copy(rec->Clone());
+            _replace(rec, copy);
+            m_data->ownership.records.insert(copy.get());
+            (*m_generation)++;
+            rec = copy;
+        }
+        if (rec->Type() == "CZONE") {
+            CZone &zone = static_cast<CZone &>(*rec);
+            zone.m_now = max(zone.m_now, m_now);
+            zone.m_generation = m_generation;
+        }
+        return rec;
     }
 
-    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
-        return os << Name() << " " << Type() << " " << IPv6();
+    bool _owns(const CRecord *rec) const {
+        return m_data.use_count() == 1 && !m_data->ownership.lent && m_data->ownership.records.count(rec) != 0;
     }
-};
 
-class CRecMX : public CRecord {
-   private:
-    string m_serverName;
-    int m_priority;
+    // some record of this zone or a nested one expires by now
+    bool _due(uint64_t now) const {
+        return m_data->expiry.Next() <= now || any_of(m_data->zones.begin(), m_data->zones.end(), [now](const shared_ptr<CZone> &it) {
+            return it->_due(now);
+        });
+    }
 
-   public:
-    CRecMX() = delete;
-    CRecMX(const string &name, const string &serverName, int priority) : CRecord(name, "MX"), m_serverName(serverName), m_priority(priority) {}
-    CRecord *Clone() const override {
-        return new CRecMX(*this);
+    // moves the deadlines of this zone and the nested ones by delta seconds, the tree gets the clock now
+    void _rebase(int64_t delta, uint64_t now) {
+        m_now = now;
+        if (m_data->expiry.Size() != 0) {
+            _detach();
+            m_data->expiry.Shift(delta);
+        }
+        for (size_t i = 0; i < m_data->zones.size(); i++) {
+            _detach();
+            static_cast<CZone &>(*_own(m_data->zones[i]->Name(), 0))._rebase(delta, now);
+        }
     }
 
-    int Priority() const { return m_priority; }
-    const string &ServerName() const { return m_serverName; }
+    // the nested zones with a record due, and the private ones (to pass them the clock), see Expire
+    size_t _expireNested() {
+        size_t expired = 0;
+        for (size_t i = 0; i < m_data->zones.size(); i++) {
+            const CZone &zone = *m_data->zones[i];
+            if (_owns(&zone) || zone._due(m_now)) {
+                const string name = zone.Name();
+                _detach();
+                expired += static_cast<CZone &>(*_own(name, 0)).Expire(m_now);
+            }
+        }
+        return expired;
+    }
 
-    bool isEqual(const CRecord &other) const override {
-        const CRecMX *rec = dynamic_cast<const CRecMX *>(&other);
-        if (rec == nullptr) {
-            return CRecord::isEqual(other);
+    // puts the copy in place of the record, in all the indexes
+    void _replace(const shared_ptr<CRecord> &rec, const shared_ptr<CRecord> &copy) {
+        *find(m_data->records.begin(), m_data->records.end(), rec) = copy;
+        vector<shared_ptr<CRecord>> &bucket = m_data->byName[rec->Name()];
+        *find(bucket.begin(), bucket.end(), rec) = copy;
+        if (const CRecA *a = dynamic_cast<const CRecA *>(rec.get())) {
+            m_data->reverseIPv4.Replace(a->IPv4().Octets(), rec, copy);
+        } else if (const CRecAAAA *aaaa = dynamic_cast<const CRecAAAA *>(rec.get())) {
+            m_data->reverseIPv6.Replace(aaaa->IPv6().Octets(), rec, copy);
+        } else if (rec->Type() == "CZONE") {
+            *find(m_data->zones.begin(), m_data->zones.end(), rec) = static_pointer_cast<CZone>(copy);
+        } else if (rec->Type() == "MX") {
+            vector<CMXView::CEntry> &entries = m_data->mxByName[rec->Name()];
+            find_if(entries.begin(), entries.end(), [&rec](const CMXView::CEntry &entry) { return entry.rec == rec; })->rec = static_pointer_cast<CRecMX>(copy);
+        }
+        // Diff matches the journal entries by identity
+        for (auto &it : m_data->journal) {
+            if (it.rec == rec) {
+                it.rec = copy;
+            }
+        }
+        if (rec->TTL() != 0 && rec->Type() != "CZONE") {
+            m_data->replaced.emplace(rec, copy);
         }
-        return (CRecord::isEqual(other) && ServerName() == rec->ServerName() && Priority() == rec->Priority());
     }
 
-    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
-        return os << Name() << " " << Type() << " " << Priority() << " " << ServerName();
+    // the record is known to be in this zone, which is already detached
+    void _remove(const shared_ptr<CRecord> &rec) {
+        _indexDel(rec);
+        _journal(false, rec);
+        m_data->ownership.records.erase(rec.get());
+        (*m_generation)++;
     }
-};
 
-class CRecCNAME : public CRecord {
-   private:
-    string m_refName;
+    void _journal(bool added, const shared_ptr<CRecord> &rec) {
+        if (m_data->journal.size() == MAX_JOURNAL) {
+            m_data->journal.pop_front();
+        }
+        m_data->journal.push_back({++m_data->version, added, rec});
+    }
 
-   public:
-    CRecCNAME() = delete;
-    CRecCNAME(const string &name, const string &referenceName) : CRecord(name, "CNAME"), m_refName(referenceName) {}
-    CRecord *Clone() const override {
-        return new CRecCNAME(*this);
+    bool _reaches(const CZone *target) const {
+        return any_of(m_data->zones.begin(), m_data->zones.end(), [target](const shared_ptr<CZone> &it) {
+            return it.get() == target || it->_reaches(target);
+        });
     }
 
-    const string &Reference() const { return m_refName; }
+    // gives this (fresh) copy its own objects on the way to target, so that target being modified
+    // afterwards does not show up in the copy; needed when a zone is added below itself
+    void _detachPathTo(const CZone *target) {
+        for (const auto &it : m_data->zones) {
+            if (it.get() == target || it->_reaches(target)) {
+                const string name = it->Name();
+                _detach();
+                static_cast<CZone &>(*_own(name, 0))._detachPathTo(target);
+                return;
+            }
+        }
+    }
 
-    bool isEqual(const CRecord &other) const override {
-        // check just the name since there can't be the same name for a CName and any other record
-        return other.Name() == Name();
+    void _indexAdd(const shared_ptr<CRecord> &rec) {
+        m_data->records.push_back(rec);
+        m_data->byName[rec->Name()].push_back(rec);
+        if (const CRecA *a = dynamic_cast<const CRecA *>(rec.get())) {
+            m_data->reverseIPv4.Insert(a->IPv4().Octets(), rec);
+        } else if (const CRecAAAA *aaaa = dynamic_cast<const CRecAAAA *>(rec.get())) {
+            m_data->reverseIPv6.Insert(aaaa->IPv6().Octets(), rec);
+        } else if (rec->Type() == "CZONE") {
+            m_data->zones.push_back(static_pointer_cast<CZone>(rec));
+        } else if (rec->Type() == "MX") {
+            shared_ptr<CRecMX> mx = static_pointer_cast<CRecMX>(rec);
+            vector<CMXView::CEntry> &entries = m_data->mxByName[rec->Name()];
+            auto it = upper_bound(entries.begin(), entries.end(), mx->Priority(), [](int priority, const CMXView::CEntry &entry) {
+                return priority < entry.rec->Priority();
+            });
+            entries.insert(it, {mx, 0, 0});
+            _groupMX(entries);
+        }
     }
 
-    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
-        return os << Name() << " " << Type() << " " << Reference();
+    static void _groupMX(vector<CMXView::CEntry> &entries) {
+        for (size_t begin = 0, end; begin < entries.size(); begin = end) {
+            for (end = begin + 1; end < entries.size() && entries[end].rec->Priority() == entries[begin].rec->Priority(); end++) {
+            }
+            for (size_t i = begin; i < end; i++) {
+                entries[i].groupBegin = begin;
+                entries[i].groupEnd = end;
+            }
+        }
     }
-};
 
-class CRecSPF : public CRecord {
-   private:
-    vector<string> m_addresses;
+    void _indexDel(const shared_ptr<CRecord> &rec) {
+        m_data->records.erase(find(m_data->records.begin(), m_data->records.end(), rec));
+        vector<shared_ptr<CRecord>> &bucket = m_data->byName[rec->Name()];
+        bucket.erase(find(bucket.begin(), bucket.end(), rec));
+        if (bucket.empty()) {
+            m_data->byName.erase(rec->Name());
+        }
+        if (const CRecA *a = dynamic_cast<const CRecA *>(rec.get())) {
+            m_data->reverseIPv4.Remove(a->IPv4().Octets(), rec);
+        } else if (const CRecAAAA *aaaa = dynamic_cast<const CRecAAAA *>(rec.get())) {
+            m_data->reverseIPv6.Remove(aaaa->IPv6().Octets(), rec);
+        } else if (rec->Type() == "CZONE") {
+            m_data->zones.erase(find(m_data->zones.begin(), m_data->zones.end(), rec));
+        } else if (rec->Type() == "MX") {
+            vector<CMXView::CEntry> &entries = m_data->mxByName[rec->Name()];
+            entries.erase(find_if(entries.begin(), entries.end(), [&rec](const CMXView::CEntry &entry) { return entry.rec == rec; }));
+            if (entries.empty()) {
+                m_data->mxByName.erase(rec->Name());
+            } else {
+                _groupMX(entries);
+            }
+        }
+    }
 
-   public:
-    CRecSPF() = delete;
-    CRecSPF(const string &name) : CRecord(name, "SPF") {}
-    CRecord *Clone() const override {
-        return new CRecSPF(*this);
+    const vector<shared_ptr<CRecord>> *_bucket(const string &recordName) const {
+        auto found = m_data->byName.find(recordName);
+        return found == m_data->byName.end() ? nullptr : &found->second;
     }
 
-    CRecSPF &Add(const string &address) {
-        m_addresses.push_back(address);
-        return *this;
+    // records a search for the label ends up with, the wildcard ("*") ones are used only if there
+    // are no records of exactly that name
+    const vector<shared_ptr<CRecord>> *_match(const string &label) const {
+        bool wildcard;
+        return _match(label, wildcard);
     }
 
-    bool isEqual(const CRecord &other) const override {
-        return CRecord::isEqual(other);
+    // the same, wildcard tells whether the records stand in for the label
+    const vector<shared_ptr<CRecord>> *_match(const string &label, bool &wildcard) const {
+        const auto *bucket = _bucket(label);
+        wildcard = bucket == nullptr || label == WILDCARD;
+        return bucket != nullptr ? bucket : _bucket(WILDCARD);
     }
 
-    ostream &Print(ostream &os, const string &padding, bool isLast) const override {
-        os << Name() << " " << Type();
-        for (auto const &it : m_addresses) {
-            if (it != *m_addresses.begin()) {
-                os << ",";
-            }
-            os << " " << it;
+    // walks this zone and all the nested ones, suffix is the dotted path of this zone below the queried one
+    template <size_t N>
+    void _reverseLookup(CAddrTrie<N> CZoneData::*trie, const typename CAddrTrie<N>::Key &key, int prefixLen,
+                        const string &suffix, vector<string> &result) const {
+        ((*m_data).*trie).Find(key, prefixLen, [&result, &suffix](const shared_ptr<CRecord> &rec) {
+            result.push_back(suffix.empty() ? rec->Name() : rec->Name() + "." + suffix);
+        });
+        for (const auto &it : m_data->zones) {
+            it->_reverseLookup(trie, key, prefixLen, suffix.empty() ? it->Name() : it->Name() + "." + suffix, result);
         }
-        return os;
     }
-};
 
-class CZone : public CRecord {
-   private:
-    vector<shared_ptr<CRecord>> m_data;
     CSearchResult _regularSearch(const string &recordName) const {
         CSearchResult result;
-        for (const auto &it : m_data) {
-            if (it->Name() == recordName) {
-                result.Add(it);
+        bool wildcard;
+        if (const auto *bucket = _match(recordName, wildcard)) {
+            // a wildcard answers under the queried name
+            string owner = wildcard ? recordName : "";
+            for (const auto &it : *bucket) {
+                result.Add(it, owner);
             }
         }
         return result;
     }
 
+    // the first count labels of the name, the part of it a wildcard record covers
+    static string _covered(const string &recordName, const vector<string> &labels, size_t count) {
+        size_t length = count - 1;
+        for (size_t i = 0; i < count; i++) {
+            length += labels[i].size();
+        }
+        return recordName.substr(0, length);
+    }
+
     CSearchResult _hierarchicSearch(const string &recordName, const char &separator) const {
         CSearchResult result;
-        vector<shared_ptr<CRecord>> dataToGoThrough = m_data;
-
         // progtest.fit.cvut.cz
-        istringstream recordStream(recordName);
-        string recordPart;
-        vector<string> toProcess;
-
-        while (getline(recordStream, recordPart, separator)) {
-            toProcess.push_back(recordPart);
-        }
-
-        auto processIt = toProcess.rbegin();
-        while (processIt != toProcess.rend()) {
-            vector<shared_ptr<CRecord>> tmp;
-            // cout << "[" << (processIt - toProcess.rbegin()) << "] "
-            //      << "Looking for: " << *processIt << " (" << recordName << ")" << endl;
-            for (const auto &it : dataToGoThrough) {
-                if (it->Name() == *processIt) {
-                    if (it->Type() == "CZONE") {
-                        // cout << "\tFound CZONE record for " << *processIt << endl;
-                        // cout << "Checking if " << *processIt << " == " << *toProcess.begin() << " (" << ((*processIt == *toProcess.begin()) ? "True" : "False") << ")" << endl;
-                        if (&*processIt == &*toProcess.begin()) {
-                            // if we are at the last index
-                            // cout << "\t\t(Result) Adding:" << endl
-                            //      << *it << "to result" << endl;
-                            result.Add(it);
-                        } else {
-                            for (const auto &it2 : dynamic_cast<CZone &>(*it).Data()) {
-                                // cout << "\t\t(TMP) Adding:" << endl
-                                //      << *it2 << "to tmp" << endl;
-                                tmp.push_back(it2);
-                            }
-                        }
+        vector<string> labels = _split(recordName, separator);
+        vector<const CZone *> zonesToGoThrough{this};
+
+        for (size_t i = labels.size(); i-- > 0;) {
+            vector<const CZone *> tmp;
+            for (const CZone *zone : zonesToGoThrough) {
+                bool wildcard;
+                const auto *bucket = zone->_match(labels[i], wildcard);
+                if (bucket == nullptr) {
+                    continue;
+                }
+                for (const auto &it : *bucket) {
+                    if (it->Type() == "CZONE" && i != 0) {
+                        // not at the last label yet, descend into the zone (a wildcard one stands for a single label)
+                        tmp.push_back(static_cast<const CZone *>(it.get()));
                     } else {
-                        // cout << "\tFound a result (" << *it << ") for " << *processIt << endl;
-                        result.Add(it);
+                        result.Add(it, wildcard ? _covered(recordName, labels, i + 1) : "");
                     }
                 }
             }
-            dataToGoThrough = tmp;
-            // cout << "After looking for: " << *processIt << ", the dataToGoThrough size is: " << dataToGoThrough.size() << endl;
-            processIt++;
+            zonesToGoThrough = move(tmp);
         }
-        // cout << "======================= (" << recordName << ") SEARCH RESULT IS: =======================" << endl;
-        // cout << result << endl;
-        // cout << "=====================================================================" << endl;
         return result;
     }
 
+    CSearchResult _resolve(const string &recordName, const string &type) const {
+        CSearchResult result;
+        set<string> visited;
+        string name = recordName;
+
+        for (int hop = 0; hop <= MAX_CNAME_HOPS; hop++) {
+            if (!visited.insert(name).second) {
+                // CNAME loop
+                return CSearchResult();
+            }
+
+            const CSearchResult records = Search(name);
+            shared_ptr<const CRecord> alias;
+            string aliasOwner;
+            bool found = false;
+            for (size_t i = 0; i < records.Data().size(); i++) {
+                const auto &it = records.Data()[i];
+                if (it->Type() == type) {
+                    result.Add(it, records.Owners()[i]);
+                    found = true;
+                } else if (it->Type() == "CNAME") {
+                    alias = it;
+                    aliasOwner = records.Owners()[i];
+                }
+            }
+            if (found || alias == nullptr) {
+                return found ? result : CSearchResult();
+            }
+
+            result.Add(alias, aliasOwner);
+            name = dynamic_cast<const CRecCNAME &>(*alias).Reference();
+            if (!name.empty() && name.back() == '.') {
+                name.pop_back();
+            }
+        }
+        // too many hops
+        return CSearchResult();
+    }
+
    public:
-    CZone(const string &zoneName) : CRecord(zoneName, "CZONE") {}
+    CZone(const string &zoneName)
+        : CRecord(zoneName, "CZONE"), m_data(make_shared<CZoneData>()), m_generation(make_shared<atomic<size_t>>(0)) {}
 
-    CRecord *Clone() const override {
-        const CZone &old = *this;
-        CZone *newZone = new CZone(old.Name());
-        for (const auto &it : old.Data()) {
-            newZone->Add(*it);
+    CZone(const CZone &other)
+        : CRecord(other), m_data(other.m_data), m_generation(make_shared<atomic<size_t>>(other.Generation())), m_now(other.m_now) {
+        m_data->ownership.lent = true;
+    }
+
+    CZone &operator=(const CZone &other) {
+        if (this != &other) {
+            CRecord::operator=(other);
+            m_data = other.m_data;
+            m_data->ownership.lent = true;
+            m_generation = make_shared<atomic<size_t>>(other.Generation());
+            m_now = other.m_now;
+            lock_guard<mutex> lock(m_resolveMemo.lock);
+            m_resolveMemo.entries.clear();
         }
-        return newZone;
+        return *this;
+    }
+
+    // O(1), the copy shares the contents (nested zones included) until one of them is modified
+    CRecord *Clone() const override {
+        return new CZone(*this);
     }
 
     bool Add(const CRecord &rec) {
-        // check if there's a rec already in the m_data;
-        auto it = find_if(m_data.begin(), m_data.end(), [&rec](const shared_ptr<CRecord> &other) { return other->isEqual(rec); });
-        if (it != m_data.end()) {
-            return false;
+        // check if there's a rec already in the zone, only records of the same name can clash
+        if (const auto *bucket = _bucket(rec.Name())) {
+            if (any_of(bucket->begin(), bucket->end(), [&rec](const shared_ptr<CRecord> &other) { return other->isEqual(rec); })) {
+                return false;
+            }
+        }
+        shared_ptr<CRecord> copy(rec.Clone());
+        if (CZone *zone = dynamic_cast<CZone *>(copy.get())) {
+            zone->_detachPathTo(this);
+            // the pending TTLs of the zone go on in the clock of this tree
+            if (zone->m_now != m_now) {
+                zone->_rebase(int64_t(m_now - zone->m_now), m_now);
+            }
+        }
+        _detach();
+        _indexAdd(copy);
+        _journal(true, copy);
+        m_data->ownership.records.insert(copy.get());
+        if (copy->TTL() != 0 && copy->Type() != "CZONE") {
+            m_data->expiry.Insert(m_now + copy->TTL(), copy);
         }
-        m_data.push_back(shared_ptr<CRecord>(rec.Clone()));
+        (*m_generation)++;
         return true;
     }
 
     bool Del(const CRecord &rec) {
-        auto it = find_if(m_data.begin(), m_data.end(), [&rec](const shared_ptr<CRecord> &other) { return other->isEqual(rec); });
-        if (it == m_data.end()) {
+        const auto *bucket = _bucket(rec.Name());
+        if (bucket == nullptr || none_of(bucket->begin(), bucket->end(), [&rec](const shared_ptr<CRecord> &other) { return other->isEqual(rec); })) {
             return false;
         }
-        m_data.erase(it);
+        // detaching replaces the nested zone objects, the record is looked up in the private contents
+        _detach();
+        bucket = _bucket(rec.Name());
+        shared_ptr<CRecord> found = *find_if(bucket->begin(), bucket->end(), [&rec](const shared_ptr<CRecord> &other) { return other->isEqual(rec); });
+        _remove(found);
         return true;
     }
 
+    /**
+     * @brief Moves the clock of the zone tree to now and removes the records whose TTL is over, as if they
+     * were deleted by Del. Records added later (to this zone or a nested one) expire TTL seconds after now.
+     * Only the zones with a record due are modified, the others stay shared with their copies.
+     * @param now Seconds on a clock of the caller's choice, only the differences matter (going back is ignored)
+     * @return size_t How many records expired
+     */
+    size_t Expire(uint64_t now) {
+        m_now = max(m_now, now);
+        size_t expired = 0;
+        if (m_data->expiry.Next() <= m_now) {
+            _detach();
+            m_data->expiry.Advance(m_now, [this, &expired](shared_ptr<CRecord> rec) {
+                for (auto it = m_data->replaced.find(rec); it != m_data->replaced.end(); it = m_data->replaced.find(rec)) {
+                    rec = it->second;
+                    m_data->replaced.erase(it);
+                }
+                // the record may be gone already (Del), or even replaced by an equal one with a new TTL
+                const auto *bucket = _bucket(rec->Name());
+                if (bucket != nullptr && find(bucket->begin(), bucket->end(), rec) != bucket->end()) {
+                    _remove(rec);
+                    expired++;
+                }
+            });
+        }
+        return expired + _expireNested();
+    }
+
+    size_t Version() const {
+        return m_data->version;
+    }
+
+    /**
+     * @brief Records added and removed since the given version of this zone (nested zones are
+     * journaled on their own, a nested zone added or removed as a whole is one record)
+     * @param fromVersion Version the other side has, see Version()
+     * @return CZoneDiff Records to remove and then add to get from fromVersion to Version()
+     * @throws out_of_range if fromVersion is no longer journaled (or is from the future),
+     * the whole zone has to be transferred then
+     */
+    CZoneDiff Diff(size_t fromVersion) const {
+        const deque<CJournalEntry> &journal = m_data->journal;
+        if (fromVersion > m_data->version || fromVersion < m_data->version - journal.size()) {
+            throw out_of_range("Version " + to_string(fromVersion) + " is not journaled");
+        }
+        CZoneDiff diff;
+        diff.from = fromVersion;
+        diff.to = m_data->version;
+
+        // records added in the range that are still there, the others cancel out
+        unordered_set<const CRecord *> present;
+        auto first = journal.end() - (m_data->version - fromVersion);
+        for (auto it = first; it != journal.end(); ++it) {
+            if (it->added) {
+                present.insert(it->rec.get());
+            } else if (present.erase(it->rec.get()) == 0) {
+                diff.removed.push_back(it->rec);
+            }
+        }
+        for (auto it = first; it != journal.end(); ++it) {
+            if (it->added && present.count(it->rec.get()) != 0) {
+                diff.added.push_back(it->rec);
+            }
+        }
+        return diff;
+    }
+
+    // replays a diff of another zone, returns false if some of the changes did not apply cleanly
+    bool ApplyDiff(const CZoneDiff &diff) {
+        bool clean = true;
+        for (const auto &it : diff.removed) {
+            clean &= Del(*it);
+        }
+        for (const auto &it : diff.added) {
+            clean &= Add(*it);
+        }
+        return clean;
+    }
+
+    /**
+     * @brief Reverse (PTR style) lookup of the names pointing at the address, nested zones included
+     * @param addr Address to look for
+     * @param prefixLen Only the first prefixLen bits of addr are compared (CIDR), the whole address by default
+     * @return vector<string> Dotted names relative to this zone, one per matching record
+     */
+    vector<string> ReverseLookup(const CIPv4 &addr, int prefixLen = CAddrTrie<4>::KEY_BITS) const {
+        if (prefixLen < 0 || prefixLen > CAddrTrie<4>::KEY_BITS) {
+            throw invalid_argument("Invalid IPv4 prefix length");
+        }
+        vector<string> result;
+        _reverseLookup(&CZoneData::reverseIPv4, addr.Octets(), prefixLen, "", result);
+        return result;
+    }
+
+    vector<string> ReverseLookup(const CIPv6 &addr, int prefixLen = CAddrTrie<16>::KEY_BITS) const {
+        if (prefixLen < 0 || prefixLen > CAddrTrie<16>::KEY_BITS) {
+            throw invalid_argument("Invalid IPv6 prefix length");
+        }
+        vector<string> result;
+        _reverseLookup(&CZoneData::reverseIPv6, addr.Octets(), prefixLen, "", result);
+        return result;
+    }
+
+    /**
+     * @brief MX records of the name by priority, without sorting or copying the records
+     * @param recordName Name (dotted names descend into the nested zones, as with Search)
+     * @param seed Random value of the caller, picks which of the records of the same priority comes first
+     * @return CMXView Ordered records, the zone contents they are in stay shared with the view (so the
+     * next change of the zone copies them while the view exists)
+     */
+    CMXView SelectMX(const string &recordName, size_t seed = 0) const {
+        const CZone *zone = this;
+        // the buckets are keyed by string, one buffer reused for all the labels (short ones fit inline)
+        string label;
+        size_t end = recordName.size(), dot;
+        while (end > 0 && (dot = recordName.rfind('.', end - 1)) != string::npos) {
+            label.assign(recordName, dot + 1, end - dot - 1);
+            const auto *bucket = zone->_match(label);
+            if (bucket == nullptr || bucket->front()->Type() != "CZONE") {
+                return CMXView();
+            }
+            zone = static_cast<const CZone *>(bucket->front().get());
+            end = dot;
+        }
+        label.assign(recordName, 0, end);
+        const auto &mx = zone->m_data->mxByName;
+        auto found = mx.find(zone->_bucket(label) != nullptr ? label : WILDCARD);
+        if (found == mx.end()) {
+            return CMXView();
+        }
+        return CMXView(shared_ptr<const vector<CMXView::CEntry>>(zone->m_data, &found->second), seed);
+    }
+
+    // a label without records of its own is matched by the wildcard ("*") records of the zone,
+    // a wildcard record that is not a zone covers all the remaining labels
     CSearchResult Search(const string &recordName) const {
         if (recordName.find('.') != std::string::npos) {
             // cout << recordName << ": running _hierarchicSearch" << endl;
@@ -349,8 +1789,74 @@ class CZone : public CRecord {
         }
     }
 
+    // the records found through a modifiable zone may be modified too (e.g. nested zones), so they
+    // and the zones on the way are made private to this copy first, the same search as the const one
+    CSearchResult Search(const string &recordName) {
+        CSearchResult result;
+        vector<string> labels = _split(recordName, '.');
+        CZone *zone = this;
+        for (size_t i = labels.size(); i-- > 0;) {
+            zone->_detach();
+            const string &bucketName = zone->_bucket(labels[i]) != nullptr ? labels[i] : WILDCARD;
+            const auto *bucket = zone->_bucket(bucketName);
+            if (bucket == nullptr) {
+                break;
+            }
+            if (bucket->front()->Type() == "CZONE" && i != 0) {
+                zone = static_cast<CZone *>(zone->_own(bucketName, 0).get());
+                continue;
+            }
+            string owner = bucketName == WILDCARD ? _covered(recordName, labels, i + 1) : "";
+            for (size_t j = 0; j < bucket->size(); j++) {
+                result.AddOwned(zone->_own(bucketName, j), owner);
+            }
+            break;
+        }
+        return result;
+    }
+
+    /**
+     * @brief Looks up records of the given type, following CNAME references (absolute names, looked up
+     * from this zone) for at most MAX_CNAME_HOPS hops.
+     * @param recordName Name to resolve
+     * @param type Wanted record type, "CNAME" stops at the first alias
+     * @return CSearchResult The CNAME records of the chain followed by the records found,
+     * empty if nothing was found, the chain loops or it is too long
+     */
+    CSearchResult Resolve(const string &recordName, const string &type) const {
+        const size_t generation = Generation();
+        const string key = type + " " + recordName;
+        {
+            lock_guard<mutex> lock(m_resolveMemo.lock);
+            if (m_resolveMemo.generation != generation) {
+                m_resolveMemo.entries.clear();
+                m_resolveMemo.generation = generation;
+            }
+            auto memo = m_resolveMemo.entries.find(key);
+            if (memo != m_resolveMemo.entries.end()) {
+                return memo->second;
+            }
+        }
+
+        // resolved without the lock, other threads may resolve (and remember) the same name meanwhile
+        CSearchResult result = _resolve(recordName, type);
+        lock_guard<mutex> lock(m_resolveMemo.lock);
+        if (m_resolveMemo.generation == generation) {
+            if (m_resolveMemo.entries.size() >= MAX_RESOLVE_MEMO) {
+                m_resolveMemo.entries.clear();
+            }
+            m_resolveMemo.entries.emplace(key, result);
+        }
+        return result;
+    }
+
+    // changes whenever the zone or a nested one changes, other zones do not affect it
+    size_t Generation() const {
+        return *m_generation;
+    }
+
     const vector<shared_ptr<CRecord>> &Data() const {
-        return m_data;
+        return m_data->records;
     }
 
     bool isEqual(const CRecord &other) const override {
@@ -359,26 +1865,156 @@ class CZone : public CRecord {
     }
 
     ostream &Print(ostream &os, const string &padding, bool isLast) const override {
-        os << Name();
-        os << endl;
-
-        const string &newPadding = padding + (!isLast ? "|  " : " ");
-        for (const auto &it : m_data) {
-            os << newPadding;
-            if (it == m_data.end()[-1]) {
-                os << "\\- ";
-                it->Print(os, newPadding + "  ", true);
-            } else {
-                os << "+- ";
-                it->Print(os, newPadding, false);
+        COutputBuffer out(os, 4096);
+        PrintTree(out, padding, isLast);
+        return os;
+    }
+
+    void PrintTo(COutputBuffer &out) const override {
+        PrintTree(out, "", true);
+    }
+
+    /**
+     * @brief Prints the zone tree iteratively, the nested zones share one indentation buffer
+     * @param out Output, may be reused for several trees
+     * @param padding Indentation of the lines below the zone name, as with Print
+     * @param isLast Whether the zone is the last record of its parent, as with Print
+     */
+    void PrintTree(COutputBuffer &out, string_view padding, bool isLast) const {
+        struct CFrame {
+            const vector<shared_ptr<CRecord>> *records;
+            size_t next;
+            size_t indent;
+        };
+        string indent(padding);
+        indent += isLast ? " " : "|  ";
+        vector<CFrame> stack{{&Data(), 0, indent.size()}};
+
+        out.Write(Name());
+        out.Put('\n');
+        while (!stack.empty()) {
+            CFrame &frame = stack.back();
+            if (frame.next == frame.records->size()) {
+                stack.pop_back();
+                continue;
             }
-            if (it->Type() != "CZONE") {
-                os << endl;
+            const CRecord &rec = *(*frame.records)[frame.next++];
+            bool last = frame.next == frame.records->size();
+            indent.resize(frame.indent);
+            out.Write(indent);
+            out.Write(last ? "\\- " : "+- ");
+            if (rec.Type() != "CZONE") {
+                rec.PrintTo(out);
+                out.Put('\n');
+                continue;
             }
+            // the last zone gets padding + "  " + " " from Print, the others padding + "|  "
+            out.Write(rec.Name());
+            out.Put('\n');
+            indent += last ? "   " : "|  ";
+            stack.push_back({&static_cast<const CZone &>(rec).Data(), 0, indent.size()});
         }
-        return os;
     }
 };
+
+/**
+ * @brief Bounded LRU cache in front of CZone::Search. The whole cache is dropped as soon as the zone
+ * generation changes, hits share the cached result instead of copying it. The cache keeps the zone alive.
+ */
+class CSearchCache {
+   private:
+    using CEntry = pair<string, shared_ptr<const CSearchResult>>;
+
+    shared_ptr<const CZone> m_zone;
+    size_t m_capacity;
+    size_t m_generation;
+    // most recently used first, the index keys point into the names stored in the list nodes
+    list<CEntry> m_lru;
+    unordered_map<string_view, list<CEntry>::iterator> m_index;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+
+   public:
+    CSearchCache(shared_ptr<const CZone> zone, size_t capacity)
+        : m_zone(move(zone)), m_capacity(max<size_t>(capacity, 1)), m_generation(m_zone->Generation()) {}
+    CSearchCache(const CSearchCache &) = delete;
+    CSearchCache &operator=(const CSearchCache &) = delete;
+
+    shared_ptr<const CSearchResult> Search(const string &recordName) {
+        if (m_generation != m_zone->Generation()) {
+            m_index.clear();
+            m_lru.clear();
+            m_generation = m_zone->Generation();
+        }
+
+        auto found = m_index.find(recordName);
+        if (found != m_index.end()) {
+            m_hits++;
+            m_lru.splice(m_lru.begin(), m_lru, found->second);
+            return found->second->second;
+        }
+
+        m_misses++;
+        if (m_lru.size() >= m_capacity) {
+            m_index.erase(m_lru.back().first);
+            m_lru.pop_back();
+        }
+        m_lru.emplace_front(recordName, make_shared<const CSearchResult>(m_zone->Search(recordName)));
+        m_index.emplace(m_lru.front().first, m_lru.begin());
+        return m_lru.front().second;
+    }
+
+    size_t Size() const { return m_lru.size(); }
+    size_t Hits() const { return m_hits; }
+    size_t Misses() const { return m_misses; }
+};
+
+/**
+ * @brief Zone tree shared by concurrent readers and a writer, RCU style. Readers take the current
+ * version with Snapshot() and search it without any locking, the version never changes under them.
+ * Writers modify a copy (cheap, the contents are shared until modified) and publish it atomically.
+ * The const methods of a version (Resolve with its memo included) may be called by any number of readers.
+ */
+class CPublishedZone {
+   private:
+    shared_ptr<const CZone> m_current;
+    // serializes the writers only
+    mutex m_writer;
+
+   public:
+    CPublishedZone(const CZone &zone) : m_current(make_shared<const CZone>(zone)) {}
+    CPublishedZone(const CPublishedZone &) = delete;
+    CPublishedZone &operator=(const CPublishedZone &) = delete;
+
+    shared_ptr<const CZone> Snapshot() const {
+        return atomic_load(&m_current);
+    }
+
+    CSearchResult Search(const string &recordName) const {
+        return Snapshot()->Search(recordName);
+    }
+
+    CSearchResult Resolve(const string &recordName, const string &type) const {
+        return Snapshot()->Resolve(recordName, type);
+    }
+
+    /**
+     * @brief Applies the change to a private copy of the current version and publishes the copy
+     * @param change Called with the copy, returns whether it modified it (e.g. the result of Add/Del)
+     * @return bool The result of change, nothing is published when it is false
+     */
+    template <typename TChange>
+    bool Update(TChange &&change) {
+        lock_guard<mutex> lock(m_writer);
+        shared_ptr<CZone> next = make_shared<CZone>(*Snapshot());
+        if (!change(*next)) {
+            return false;
+        }
+        atomic_store(&m_current, shared_ptr<const CZone>(move(next)));
+        return true;
+    }
+};
+
 #ifndef __PROGTEST__
 int main(void) {
     ostringstream oss;
@@ -1066,6 +2702,323 @@ int main(void) {
            " |        \\- www AAAA 1:2:3:4:5:6:7:8\n"
            " \\- au\n");
 
+    CZone z30("<ROOT ZONE>");
+    CZone z31("cz");
+    assert(z31.Add(CRecA("www", CIPv4("147.32.232.1"))) == true);
+    assert(z31.Add(CRecA("mail", CIPv4("147.32.233.1"))) == true);
+    assert(z31.Add(CRecAAAA("www", CIPv6("2001:718:2:2902:0:1:2:3"))) == true);
+    assert(z30.Add(z31) == true);
+    assert(z30.Add(CRecA("cdn", CIPv4("147.32.232.1"))) == true);
+    assert((z30.ReverseLookup(CIPv4("147.32.232.1")) == vector<string>{"cdn", "www.cz"}));
+    assert((z30.ReverseLookup(CIPv4("147.32.232.0"), 23) == vector<string>{"cdn", "www.cz", "mail.cz"}));
+    assert((z30.ReverseLookup(CIPv4("147.32.232.0"), 24) == vector<string>{"cdn", "www.cz"}));
+    assert((z30.ReverseLookup(CIPv6("2001:718:2:2902:0:0:0:0"), 64) == vector<string>{"www.cz"}));
+    assert(z30.ReverseLookup(CIPv4("147.32.232.2")).empty());
+    assert(z30.Del(CRecA("cdn", CIPv4("147.32.232.1"))) == true);
+    assert((z30.ReverseLookup(CIPv4("147.32.232.1")) == vector<string>{"www.cz"}));
+
+    assert(z31.Add(CRecCNAME("web", "www.cz.")) == true);
+    assert(z31.Add(CRecCNAME("site", "web.cz.")) == true);
+    assert(z31.Add(CRecCNAME("loop1", "loop2.cz.")) == true);
+    assert(z31.Add(CRecCNAME("loop2", "loop1.cz.")) == true);
+    assert(z30.Add(z31) == false);
+    assert(z30.Del(CZone("cz")) == true);
+    assert(z30.Add(z31) == true);
+    oss.str("");
+    oss << z30.Resolve("site.cz", "A");
+    assert(oss.str() ==
+           "site CNAME web.cz.\n"
+           "web CNAME www.cz.\n"
+           "www A 147.32.232.1\n");
+    assert(z30.Resolve("site.cz", "AAAA").Count() == 3);
+    assert(z30.Resolve("site.cz", "CNAME").Count() == 1);
+    assert(z30.Resolve("site.cz", "MX").Count() == 0);
+    assert(z30.Resolve("loop1.cz", "A").Count() == 0);
+    assert(dynamic_cast<CZone &>(z30.Search("cz")[0]).Del(CRecA("www", CIPv4("147.32.232.1"))) == true);
+    assert(z30.Resolve("site.cz", "A").Count() == 0);
+
+    size_t generation = z0.Generation();
+    CZone &nested = dynamic_cast<CZone &>(z30.Search("cz")[0]);
+    assert(nested.Add(CRecA("tmp", CIPv4("147.32.232.2"))) == true && z0.Generation() == generation);
+    generation = z30.Generation();
+    assert(nested.Del(CRecA("tmp", CIPv4("147.32.232.2"))) == true && z30.Generation() != generation);
+    shared_ptr<CZone> cached = make_shared<CZone>(z30);
+    CSearchCache cache(cached, 2);
+    assert(cache.Search("www.cz")->Count() == 1);
+    assert(cache.Search("mail.cz")->Count() == 1);
+    assert(cache.Search("www.cz") == cache.Search("www.cz"));
+    assert(cache.Search("web.cz")->Count() == 1);
+    assert(cache.Size() == 2 && cache.Hits() == 2 && cache.Misses() == 3);
+    assert(cache.Search("mail.cz")->Count() == 1);
+    assert(cache.Misses() == 4);
+    assert(dynamic_cast<CZone &>(cached->Search("cz")[0]).Del(CRecA("mail", CIPv4("147.32.233.1"))) == true);
+    assert(cache.Search("mail.cz")->Count() == 0 && z30.Search("mail.cz").Count() == 1);
+    assert(cache.Size() == 1 && cache.Misses() == 5);
+
+    CZone z32(z30);
+    assert(dynamic_cast<CZone &>(z32.Search("cz")[0]).Add(CRecA("ftp", CIPv4("147.32.232.21"))) == true);
+    assert(z32.Search("ftp.cz").Count() == 1);
+    assert(z30.Search("ftp.cz").Count() == 0);
+    assert(z30.Add(CRecA("ns", CIPv4("147.32.232.53"))) == true);
+    assert(z32.Search("ns").Count() == 0);
+    assert((z32.ReverseLookup(CIPv4("147.32.232.0"), 24) == vector<string>{"ftp.cz"}));
+    assert((z30.ReverseLookup(CIPv4("147.32.232.0"), 24) == vector<string>{"ns"}));
+    CZone z33(z32);
+    assert(z32.Del(CZone("cz")) == true && z32.Search("ftp.cz").Count() == 0);
+    assert(z33.Search("ftp.cz").Count() == 1 && z33.Del(CZone("cz")) == true && z33.Search("cz").Count() == 0);
+    CZone spfZone("cz");
+    assert(spfZone.Add(CRecSPF("mail").Add("ip4:147.32.232.0/24")) == true);
+    assert(spfZone.Add(CRecA("www", CIPv4("147.32.232.1")).SetTTL(10)) == true);
+    CZone spfCopy(spfZone);
+    dynamic_cast<CRecSPF &>(spfZone.Search("mail")[0]).Add("-all");
+    assert(dynamic_cast<const CRecSPF &>(spfZone.Search("mail")[0]).Evaluate(CIPv4("10.0.0.1")) == '-');
+    assert(dynamic_cast<const CRecSPF &>(spfCopy.Search("mail")[0]).Evaluate(CIPv4("10.0.0.1")) == CRecSPF::NO_MATCH);
+    // the const search hands out the shared records, a change through its result only reaches a private clone
+    const CZone &spfView = spfCopy;
+    CSearchResult spfShared = spfView.Search("mail");
+    dynamic_cast<CRecSPF &>(spfShared[0]).Add("-all");
+    assert(dynamic_cast<const CRecSPF &>(spfShared[0]).Evaluate(CIPv4("10.0.0.1")) == '-');
+    assert(dynamic_cast<const CRecSPF &>(spfView.Search("mail")[0]).Evaluate(CIPv4("10.0.0.1")) == CRecSPF::NO_MATCH);
+    assert(spfZone.Search("www").Count() == 1 && spfZone.Expire(10) == 1 && spfZone.Search("www").Count() == 0);
+    assert(spfCopy.Search("www").Count() == 1 && (spfCopy.ReverseLookup(CIPv4("147.32.232.1")) == vector<string>{"www"}));
+
+    assert(z0.SelectMX("courses").Count() == 2);
+    assert(z0.SelectMX("courses")[0].ServerName() == "relay.fit.cvut.cz." && z0.SelectMX("courses")[1].Priority() == 10);
+    assert(z0.Add(CRecMX("courses", "relay3.fit.cvut.cz.", 0)) == true);
+    assert(z0.SelectMX("courses", 1)[0].ServerName() == "relay3.fit.cvut.cz." && z0.SelectMX("courses", 1)[1].ServerName() == "relay.fit.cvut.cz.");
+    assert(z0.SelectMX("courses", 2)[0].ServerName() == "relay.fit.cvut.cz." && z0.SelectMX("courses", 2)[2].Priority() == 10);
+    assert(z0.Del(CRecMX("courses", "relay.fit.cvut.cz.", 0)) == true);
+    assert(z0.SelectMX("courses", 1)[0].ServerName() == "relay3.fit.cvut.cz." && z0.SelectMX("courses").Count() == 2);
+    assert(z0.SelectMX("progtest").Count() == 0 && z0.SelectMX("nothing.courses").Count() == 0);
+    CZone mxRoot("<ROOT ZONE>");
+    CZone mxZone("cz");
+    assert(mxZone.Add(CRecMX("mail", "relay.cz.", 5)) == true);
+    assert(mxRoot.Add(mxZone) == true);
+    assert(mxRoot.SelectMX("mail.cz").Count() == 1 && mxRoot.SelectMX("mail.cz")[0].Priority() == 5);
+    CMXView mxView = mxRoot.SelectMX("mail.cz");
+    assert(dynamic_cast<CZone &>(mxRoot.Search("cz")[0]).Add(CRecMX("mail", "relay2.cz.", 1)) == true);
+    assert(mxRoot.Del(CZone("cz")) == true && mxView.Count() == 1 && mxView[0].ServerName() == "relay.cz.");
+
+    assert(CIPv6("2001:718:2:2902:0:1:2:3") == CIPv6("2001:718:2:2902:0:1:2:3"));
+    assert(CIPv6("2001:718:2:2902:0:1:2:3") < CIPv6("2001:718:2:2902:0:1:2:4") && CIPv6("2001:718:2:2902:0:1:2:4") >= CIPv6("2001:718:2:2902:0:1:2:4"));
+    assert(CIPv6("0:1:0:0:0:0:0:0") > CIPv6("0:0:ffff:ffff:ffff:ffff:ffff:ffff") && CIPv4("10.0.0.1") < CIPv4("147.32.232.1"));
+    unordered_set<CIPv6> addresses{CIPv6("2001:718:2:2902:0:1:2:3"), CIPv6("2001:718:2:2902:0:1:2:3"), CIPv6("2001:718:2:2902:1:2:3:4")};
+    assert(addresses.size() == 2 && addresses.count(CIPv6("2001:718:2:2902:1:2:3:4")) == 1);
+    assert(hash<CIPv4>()(CIPv4("147.32.232.1")) != hash<CIPv4>()(CIPv4("147.32.232.2")));
+    // the from_chars style parsers report errors by code and leave the address alone on failure
+    CIPv4 parsed4("10.0.0.1");
+    auto parse4 = [&parsed4](string_view text) { return CIPv4::FromChars(text.data(), text.data() + text.size(), parsed4); };
+    assert(parse4("1.2.3").ec == errc::invalid_argument && parse4("1.2..3.4").ec == errc::invalid_argument && parse4("").ec == errc::invalid_argument);
+    assert(parse4("1.2.3.256").ec == errc::result_out_of_range && parse4("1.2.3.1000").ec == errc::result_out_of_range);
+    assert(parsed4 == CIPv4("10.0.0.1"));
+    string_view trailing = "147.32.232.1/24";
+    auto result4 = parse4(trailing);
+    assert(result4.ec == errc() && result4.ptr == trailing.data() + 12 && parsed4 == CIPv4("147.32.232.1"));
+    CIPv6 parsed6("0:0:0:0:0:0:0:1");
+    auto parse6 = [&parsed6](string_view text) { return CIPv6::FromChars(text.data(), text.data() + text.size(), parsed6); };
+    // only the full form of eight groups is accepted, :: is not expanded
+    assert(parse6("::1").ec == errc::invalid_argument && parse6("1::").ec == errc::invalid_argument && parse6("::").ec == errc::invalid_argument);
+    assert(parse6("1:2:3:4:5:6:7").ec == errc::invalid_argument && parse6("1:2:3:4:5:6:7:12345").ec == errc::result_out_of_range);
+    assert(parsed6 == CIPv6("0:0:0:0:0:0:0:1"));
+    trailing = "2001:718:2:2902:0:1:2:3::";
+    auto result6 = parse6(trailing);
+    assert(result6.ec == errc() && result6.ptr == trailing.data() + 23 && parsed6 == CIPv6("2001:718:2:2902:0:1:2:3"));
+    char text[CIPv6::MAX_CHARS];
+    auto short4 = CIPv4("147.32.232.1").ToChars(text, text + 11);
+    assert(short4.ec == errc::value_too_large && short4.ptr == text + 11);
+    auto fits4 = CIPv4("147.32.232.1").ToChars(text, text + 12);
+    assert(fits4.ec == errc() && string_view(text, fits4.ptr - text) == "147.32.232.1");
+    auto short6 = CIPv6("2001:718:2:2902:0:1:2:3").ToChars(text, text + 5);
+    assert(short6.ec == errc::value_too_large && short6.ptr == text + 5);
+    auto fits6 = CIPv6("2001:718:2:2902:0:1:2:3").ToChars(text, text + CIPv6::MAX_CHARS);
+    assert(fits6.ec == errc() && string_view(text, fits6.ptr - text) == "2001:718:2:2902:0:1:2:3");
+
+    CZone resolverZone("cache");
+    assert(resolverZone.Add(CRecA("www", CIPv4("147.32.232.1")).SetTTL(60)) == true);
+    assert(resolverZone.Add(CRecA("www", CIPv4("147.32.232.2")).SetTTL(5000)) == true);
+    assert(resolverZone.Add(CRecCNAME("web", "www.cache.").SetTTL(60)) == true);
+    assert(resolverZone.Add(CRecA("static", CIPv4("147.32.232.3"))) == true);
+    assert(resolverZone.Add(CZone("nested")) == true);
+    assert(dynamic_cast<CZone &>(resolverZone.Search("nested")[0]).Add(CRecMX("mail", "relay.cache.", 0).SetTTL(100)) == true);
+    assert(resolverZone.Del(CRecCNAME("web", "www.cache.")) == true);
+    CZone cacheCopy(resolverZone);
+    assert(resolverZone.Expire(59) == 0 && resolverZone.Search("www").Count() == 2);
+    assert(resolverZone.Expire(60) == 1 && resolverZone.Search("www").Count() == 1);
+    assert(resolverZone.Add(CRecCNAME("web", "www.cache.").SetTTL(60)) == true);
+    assert(resolverZone.Expire(110) == 1 && resolverZone.Search("nested").Count() == 1 && resolverZone.Search("mail.nested").Count() == 0);
+    assert(resolverZone.Expire(119) == 0 && resolverZone.Expire(120) == 1 && resolverZone.Search("web").Count() == 0);
+    assert(resolverZone.Expire(4999) == 0 && resolverZone.Expire(1000000) == 1 && resolverZone.Search("www").Count() == 0);
+    assert(resolverZone.Search("static").Count() == 1 && cacheCopy.Search("www").Count() == 2);
+    assert(cacheCopy.Expire(4999) == 2 && cacheCopy.Search("www").Count() == 1);
+    CZone clockRoot("root");
+    CZone standalone("early");
+    assert(standalone.Add(CRecA("ftp", CIPv4("147.32.232.21")).SetTTL(50)) == true);
+    assert(clockRoot.Expire(1000) == 0 && clockRoot.Add(CZone("late")) == true);
+    assert(dynamic_cast<CZone &>(clockRoot.Search("late")[0]).Add(CRecA("www", CIPv4("147.32.232.1")).SetTTL(100)) == true);
+    assert(clockRoot.Expire(1001) == 0 && clockRoot.Search("www.late").Count() == 1);
+    CZone clockCopy(clockRoot);
+    assert(clockRoot.Expire(1100) == 1 && clockRoot.Search("www.late").Count() == 0 && clockCopy.Search("www.late").Count() == 1);
+    assert(clockRoot.Add(standalone) == true && clockRoot.Expire(1149) == 0 && clockRoot.Search("ftp.early").Count() == 1);
+    assert(clockRoot.Expire(1150) == 1 && clockRoot.Search("ftp.early").Count() == 0 && standalone.Expire(50) == 1);
+
+    CRecSPF spf("mail");
+    spf.Add("ip4:147.32.232.128/25").Add("ip4:147.32.232.64/26").Add("-ip4:10.0.0.0/8").Add("ip4:147.32.232.10");
+    spf.Add("ip6:2001:718:2:2902:0:0:0:0/64").Add("include:_spf.cvut.cz").Add("mx").Add("~all");
+    assert(spf.Evaluate(CIPv4("147.32.232.200")) == '+' && spf.Matches(CIPv4("147.32.232.64")));
+    assert(spf.Matches(CIPv4("147.32.232.10")) && spf.Evaluate(CIPv4("147.32.232.11")) == CRecSPF::NEEDS_LOOKUP);
+    assert(spf.Evaluate(CIPv4("10.1.2.3")) == '-' && !spf.Matches(CIPv4("10.1.2.3")));
+    assert(spf.Matches(CIPv6("2001:718:2:2902:1:2:3:4")) && spf.Evaluate(CIPv6("2001:718:2:2903:1:2:3:4")) == CRecSPF::NEEDS_LOOKUP);
+    assert(CRecSPF("x").Add("mx").Add("-all").Evaluate(CIPv4("1.2.3.4")) == CRecSPF::NEEDS_LOOKUP && !CRecSPF("x").Add("a").Matches(CIPv6("0:0:0:0:0:0:0:1")));
+    assert(CRecSPF("x").Add("ip4:1.2.3.0/24").Add("a:mail.cz").Add("~all").Evaluate(CIPv4("1.2.3.4")) == '+');
+    assert((spf.Includes() == vector<string_view>{"_spf.cvut.cz"}));
+    assert(CRecSPF("x").Add("ip4:1.2.3.4/33").Add("bogus").Evaluate(CIPv4("1.2.3.4")) == CRecSPF::NO_MATCH);
+    oss.str("");
+    oss << spf;
+    assert(oss.str() == "mail SPF ip4:147.32.232.128/25, ip4:147.32.232.64/26, -ip4:10.0.0.0/8, ip4:147.32.232.10, "
+                        "ip6:2001:718:2:2902:0:0:0:0/64, include:_spf.cvut.cz, mx, ~all");
+
+    CZone customers("customer");
+    assert(customers.Add(CRecA("*", CIPv4("147.32.232.10"))) == true);
+    assert(customers.Add(CRecA("www", CIPv4("147.32.232.11"))) == true);
+    assert(customers.Add(CZone("eu")) == true);
+    assert(dynamic_cast<CZone &>(customers.Search("eu")[0]).Add(CRecCNAME("*", "www.customer.")) == true);
+    CZone example("example");
+    assert(example.Add(customers) == true);
+    oss.str("");
+    oss << example.Search("acme.customer") << example.Search("www.customer")
+        << example.Search("a.b.customer") << example.Search("shop.eu.customer");
+    assert(oss.str() ==
+           "* A 147.32.232.10\n"
+           "www A 147.32.232.11\n"
+           "* A 147.32.232.10\n"
+           "* CNAME www.customer.\n");
+    assert(customers.Search("acme").Count() == 1);
+    assert(example.Search("customer").Count() == 1);
+    assert(example.Search("acme").Count() == 0);
+    assert(example.Resolve("shop.eu.customer", "A")[1].Name() == "www");
+    // on the wire a wildcard answers under the queried name (RFC 4592)
+    uint8_t wildWire[64];
+    CWireBuffer wildBuffer(wildWire, sizeof(wildWire));
+    assert(customers.Search("acme").SerializeWire(wildBuffer, "customer") == 1 && wildBuffer.Size() == 29);
+    assert(wildWire[0] == 4 && string_view(reinterpret_cast<const char *>(wildWire) + 1, 4) == "acme" && wildWire[5] == 8 && wildWire[16] == 1);
+    const CZone &exampleView = example;
+    for (const CSearchResult &found : {example.Search("a.b.customer"), exampleView.Search("a.b.customer")}) {
+        wildBuffer.Clear();
+        assert(found.SerializeWire(wildBuffer, "customer.example") == 1 && wildBuffer.Size() == 36);
+        assert(wildWire[0] == 1 && wildWire[1] == 'a' && wildWire[2] == 1 && wildWire[3] == 'b' && wildWire[4] == 8);
+    }
+    wildBuffer.Clear();
+    assert(customers.Search("www").SerializeWire(wildBuffer, "customer") == 1 && wildWire[0] == 3 && wildWire[1] == 'w');
+    assert(example.Resolve("shop.eu.customer", "A").Owners() == (vector<string>{"shop", ""}));
+
+    CZone primary("cz");
+    assert(primary.Add(CRecA("www", CIPv4("147.32.232.1"))) == true);
+    assert(primary.Add(CRecA("mail", CIPv4("147.32.233.1"))) == true);
+    CZone secondary(primary);
+    size_t synced = primary.Version();
+    assert(synced == 2);
+    assert(primary.Add(CRecA("tmp", CIPv4("147.32.233.2"))) == true);
+    assert(primary.Del(CRecA("tmp", CIPv4("147.32.233.2"))) == true);
+    assert(primary.Del(CRecA("mail", CIPv4("147.32.233.1"))) == true);
+    assert(primary.Add(CZone("fit")) == true);
+    assert(dynamic_cast<CZone &>(primary.Search("fit")[0]).Add(CRecA("progtest", CIPv4("147.32.232.142"))) == true);
+    assert(primary.Del(CRecA("www", CIPv4("147.32.232.1"))) == true);
+    assert(primary.Add(CRecA("www", CIPv4("147.32.232.2"))) == true);
+    CZoneDiff diff = primary.Diff(synced);
+    assert(diff.from == 2 && diff.to == 8 && diff.removed.size() == 2 && diff.added.size() == 2);
+    assert(secondary.ApplyDiff(diff) == true);
+    oss.str("");
+    oss << primary;
+    ostringstream transferred;
+    transferred << secondary;
+    assert(oss.str() == transferred.str());
+    assert(primary.Diff(primary.Version()).added.empty());
+    try {
+        primary.Diff(primary.Version() + 1);
+        assert("No exception thrown!" == nullptr);
+    } catch (const out_of_range &e) {
+    } catch (...) {
+        assert("Invalid exception thrown!" == nullptr);
+    }
+
+    ostringstream printed;
+    {
+        COutputBuffer out(printed, 1);
+        z20.PrintTo(out);
+        z30.Search("cz")[0].PrintTo(out);
+    }
+    oss.str("");
+    oss << z20 << z30.Search("cz")[0];
+    assert(printed.str() == oss.str());
+
+    uint8_t wire[80];
+    CWireBuffer wireBuffer(wire, sizeof(wire));
+    assert(z31.Search("mail").SerializeWire(wireBuffer, "cz") == 1);
+    assert(wireBuffer.Size() == 23 && !wireBuffer.Failed());
+    assert(wire[0] == 4 && wire[5] == 2 && wire[8] == 0 && wire[10] == 1 && wire[12] == 1 && wire[18] == 4);
+    assert(CSearchResult().SerializeWire(wireBuffer) == 0);
+    assert(z31.Search("www").SerializeWire(wireBuffer, "CZ") == 2);
+    // "cz" and then the whole owner name are pointers to the names written before
+    assert(wireBuffer.Size() == 71 && wire[23] == 3 && wire[27] == 0xC0 && wire[28] == 5);
+    assert(wire[43] == 0xC0 && wire[44] == 23 && wire[46] == 28);
+    assert(z31.Search("mail").SerializeWire(wireBuffer, "cz") == 1 && wireBuffer.Failed());
+    wireBuffer.Clear();
+    assert(z30.Search("cz").SerializeWire(wireBuffer) == 0 && wireBuffer.Size() == 0);
+    // SPF goes out as one "v=spf1 ..." text, split into strings of at most 255 bytes once it gets longer
+    uint8_t spfWire[512];
+    CWireBuffer spfBuffer(spfWire, sizeof(spfWire));
+    assert(CRecSPF("mail").Add("ip4:1.2.3.4").Add("ip4:5.6.7.8").SerializeWire(spfBuffer, "") && spfBuffer.Size() == 47);
+    assert(spfWire[14] == 0 && spfWire[15] == 31 && spfWire[16] == 30);
+    assert(string_view(reinterpret_cast<const char *>(spfWire) + 17, 30) == "v=spf1 ip4:1.2.3.4 ip4:5.6.7.8");
+    CRecSPF longSpf("mail");
+    string longText = "v=spf1";
+    for (int i = 10; i < 40; i++) {
+        longSpf.Add("ip4:10.0.0." + to_string(i));
+        longText += " ip4:10.0.0." + to_string(i);
+    }
+    spfBuffer.Clear();
+    assert(longSpf.SerializeWire(spfBuffer, "") && !spfBuffer.Failed() && longText.size() == 426);
+    assert(spfWire[14] == 428 >> 8 && spfWire[15] == (428 & 0xFF) && spfWire[16] == 255 && spfWire[16 + 256] == 171);
+    assert(string(reinterpret_cast<const char *>(spfWire) + 17, 255) + string(reinterpret_cast<const char *>(spfWire) + 17 + 256, 171) == longText);
+
+    CPublishedZone published(z30);
+    shared_ptr<const CZone> version = published.Snapshot();
+    assert(published.Update([](CZone &zone) { return dynamic_cast<CZone &>(zone.Search("cz")[0]).Add(CRecA("api", CIPv4("147.32.232.80"))); }) == true);
+    assert(published.Update([](CZone &zone) { return zone.Add(CRecA("ns", CIPv4("147.32.232.53"))); }) == false);
+    assert(published.Search("api.cz").Count() == 1);
+    assert(version->Search("api.cz").Count() == 0);
+    assert(z30.Search("api.cz").Count() == 0);
+    assert(published.Snapshot() != version);
+    assert(dynamic_cast<CZone &>(published.Search("cz")[0]).Add(CRecA("rogue", CIPv4("147.32.232.66"))) == true);
+    assert(published.Search("rogue.cz").Count() == 0 && published.Snapshot()->Search("rogue.cz").Count() == 0);
+
+    // readers search and resolve the published versions while the writer keeps adding records
+    CZone site("<ROOT ZONE>");
+    assert(site.Add(CRecCNAME("www", "web.")) == true);
+    CPublishedZone live(site);
+    atomic<bool> done{false};
+    vector<thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&live, &done]() {
+            int seen = 0;
+            while (!done) {
+                shared_ptr<const CZone> current = live.Snapshot();
+                int count = current->Search("web").Count();
+                assert(count >= seen && current->Resolve("www", "A").Count() == (count == 0 ? 0 : count + 1));
+                assert(live.Resolve("www", "CNAME").Count() == 1);
+                seen = count;
+            }
+        });
+    }
+    for (int i = 0; i < 200; i++) {
+        assert(live.Update([i](CZone &zone) { return zone.Add(CRecA("web", CIPv4("147.32.232." + to_string(i)))); }) == true);
+    }
+    done = true;
+    for (auto &it : readers) {
+        it.join();
+    }
+    assert(live.Resolve("www", "A").Count() == 201 && site.Search("web").Count() == 0);
+
     return 0;
 }
 #endif /* __PROGTEST__ */
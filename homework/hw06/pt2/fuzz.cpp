@@ -0,0 +1,206 @@
+// Fuzz target of the zone engine in dns.cpp, either driven by libFuzzer:
+//   clang++ -std=c++17 -g -DDNS_LIBFUZZER -fsanitize=fuzzer,address,undefined fuzz.cpp -o fuzz && ./fuzz
+// or standalone with random inputs:
+//   g++ -std=c++17 -g -fsanitize=address,undefined fuzz.cpp -o fuzz && ./fuzz [iterations] [seed]
+#define __PROGTEST__
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "ipaddress.h"
+using namespace std;
+
+#include "dns.cpp"
+
+/**
+ * @brief Turns the fuzzer input into operations on a small zone tree. Names are built from a tiny
+ * alphabet (dots, wildcards and empty labels included), so that they collide often.
+ */
+class CFuzzInput {
+   private:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+
+   public:
+    // zones added during one run, every one of them may copy the whole tree into itself
+    static const int MAX_ZONE_ADDS = 4;
+
+    CFuzzInput(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+    bool Empty() const { return m_pos == m_size; }
+
+    uint8_t Byte() {
+        return m_pos < m_size ? m_data[m_pos++] : 0;
+    }
+
+    string Name() {
+        static const char alphabet[] = "ab*.";
+        string name;
+        for (size_t length = Byte() % 8; length > 0; length--) {
+            name += alphabet[Byte() % 4];
+        }
+        return name;
+    }
+
+    CIPv4 IPv4() {
+        return CIPv4("147.32." + to_string(Byte() % 4) + "." + to_string(Byte()));
+    }
+
+    CIPv6 IPv6() {
+        return CIPv6("2001:718:2:2902:0:1:" + to_string(Byte() % 4) + ":" + to_string(Byte() % 100));
+    }
+
+    shared_ptr<CRecord> Record(int &zoneAdds) {
+        switch (Byte() % 6) {
+            case 0:
+                return make_shared<CRecA>(Name(), IPv4());
+            case 1:
+                return make_shared<CRecAAAA>(Name(), IPv6());
+            case 2:
+                return make_shared<CRecMX>(Name(), Name(), Byte());
+            case 3:
+                return make_shared<CRecCNAME>(Name(), Name());
+            case 4:
+                return make_shared<CRecSPF>(CRecSPF(Name()).Add(Name()));
+            default:
+                zoneAdds++;
+                return make_shared<CZone>(Name());
+        }
+    }
+};
+
+// the zone the operation goes to, the root or one found below it
+static CZone &PickZone(CZone &root, CFuzzInput &input) {
+    CSearchResult found = root.Search(input.Name());
+    for (int i = 0; i < found.Count(); i++) {
+        if (CZone *zone = dynamic_cast<CZone *>(&found[i])) {
+            return *zone;
+        }
+    }
+    return root;
+}
+
+static string Printed(const CRecord &rec) {
+    ostringstream oss;
+    oss << rec;
+    return oss.str();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    CFuzzInput input(data, size);
+    CZone root("<ROOT ZONE>");
+    int zoneAdds = 0;
+
+    while (!input.Empty()) {
+        switch (input.Byte() % 8) {
+            case 0:
+            case 1: {
+                shared_ptr<CRecord> rec = input.Record(zoneAdds);
+                CZone &zone = PickZone(root, input);
+                // a second Add of the same record never succeeds
+                if (zone.Add(*rec)) {
+                    assert(zone.Add(*rec) == false);
+                }
+                break;
+            }
+            case 2: {
+                CZone &zone = PickZone(root, input);
+                if (zoneAdds < CFuzzInput::MAX_ZONE_ADDS && zone.Add(root)) {
+                    zoneAdds++;
+                }
+                break;
+            }
+            case 3: {
+                // reference model: Del removes the first record equal to rec (CNAME clashes with any
+                // record of its name), nothing else
+                shared_ptr<CRecord> rec = input.Record(zoneAdds);
+                CZone &zone = PickZone(root, input);
+                vector<string> expected;
+                bool present = false;
+                for (const auto &it : zone.Data()) {
+                    if (!present && it->isEqual(*rec)) {
+                        present = true;
+                    } else {
+                        expected.push_back(Printed(*it));
+                    }
+                }
+                assert(zone.Del(*rec) == present);
+                vector<string> remaining;
+                for (const auto &it : zone.Data()) {
+                    remaining.push_back(Printed(*it));
+                }
+                assert(remaining == expected);
+                break;
+            }
+            case 4: {
+                // the const and the detaching Search have to agree
+                string name = input.Name();
+                const CZone &view = root;
+                ostringstream constResult, result;
+                constResult << view.Search(name);
+                result << root.Search(name);
+                assert(constResult.str() == result.str());
+                break;
+            }
+            case 5:
+                root.Resolve(input.Name(), "A");
+                break;
+            case 6:
+                root.ReverseLookup(input.IPv4(), input.Byte() % 33);
+                root.ReverseLookup(input.IPv6(), input.Byte() % 129);
+                break;
+            default: {
+                // a copy keeps the state it was made with
+                unique_ptr<CRecord> copy(root.Clone());
+                string before = Printed(root);
+                assert(Printed(*copy) == before);
+                PickZone(root, input).Add(*input.Record(zoneAdds));
+                assert(Printed(*copy) == before);
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+#ifndef DNS_LIBFUZZER
+int main(int argc, char *argv[]) {
+    size_t iterations = argc > 1 ? stoul(argv[1]) : 10000;
+    mt19937 random(argc > 2 ? stoul(argv[2]) : 1);
+    vector<uint8_t> data;
+
+    for (size_t i = 0; i < iterations; i++) {
+        data.resize(random() % 256);
+        generate(data.begin(), data.end(), [&random]() { return uint8_t(random()); });
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+    cout << iterations << " inputs OK" << endl;
+    return 0;
+}
+#endif /* DNS_LIBFUZZER */
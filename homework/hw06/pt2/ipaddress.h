@@ -14,11 +14,17 @@
 #include <list>
 #include <algorithm>
 #include <memory>
+#include <array>
+#include <charconv>
+#include <system_error>
+#include <functional>
 
 
 class CIPv4
 {
   public:
+    // longest textual form, "255.255.255.255"
+    static constexpr int     MAX_CHARS                     = 15;
     //---------------------------------------------------------------------------------------------
                              CIPv4                         ( void )
     {
@@ -27,26 +33,131 @@ class CIPv4
     //---------------------------------------------------------------------------------------------
                              CIPv4                         ( const std::string & src )
     {
-      std::istringstream iss ( src );
-      if ( !( iss >> *this ) || ! iss . eof () )
+      const char * end = src . data () + src . size ();
+      std::from_chars_result res = FromChars ( src . data (), end, *this );
+      if ( res . ec != std::errc () || res . ptr != end )
         throw std::invalid_argument ( src );
     }
     //---------------------------------------------------------------------------------------------
     bool                     operator ==                   ( const CIPv4     & x ) const
     {
+      return Value () == x . Value ();
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator !=                   ( const CIPv4     & x ) const
+    {
+      return Value () != x . Value ();
+    }
+    //---------------------------------------------------------------------------------------------
+    // total order, the same as the numeric order of the addresses
+    bool                     operator <                    ( const CIPv4     & x ) const
+    {
+      return Value () < x . Value ();
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator >                    ( const CIPv4     & x ) const
+    {
+      return x < *this;
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator <=                   ( const CIPv4     & x ) const
+    {
+      return ! ( x < *this );
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator >=                   ( const CIPv4     & x ) const
+    {
+      return ! ( *this < x );
+    }
+    //---------------------------------------------------------------------------------------------
+    // the address as a number, the first octet being the most significant
+    std::uint32_t            Value                         ( void ) const
+    {
+      return std::uint32_t ( m_Addr[0] ) << 24 | std::uint32_t ( m_Addr[1] ) << 16
+             | std::uint32_t ( m_Addr[2] ) << 8 | m_Addr[3];
+    }
+    //---------------------------------------------------------------------------------------------
+    std::size_t              Hash                          ( void ) const
+    {
+      return Mix ( Value () );
+    }
+    //---------------------------------------------------------------------------------------------
+    // 64 bit finalizer (splitmix64), spreads the address bits over the whole hash
+    static std::size_t       Mix                           ( std::uint64_t     x )
+    {
+      x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+      x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+      return static_cast<std::size_t> ( x ^ ( x >> 31 ) );
+    }
+    //---------------------------------------------------------------------------------------------
+    // network order bytes of the address
+    std::array<std::uint8_t, 4> Octets                     ( void ) const
+    {
+      return { { m_Addr[0], m_Addr[1], m_Addr[2], m_Addr[3] } };
+    }
+    //---------------------------------------------------------------------------------------------
+    // parses a dotted quad from [first, last) in the from_chars fashion: no allocation, no exceptions,
+    // x is only modified on success and the returned ptr points past the consumed characters
+    static std::from_chars_result FromChars                ( const char      * first,
+                                                             const char      * last,
+                                                             CIPv4           & x ) noexcept
+    {
+      std::uint8_t addr[4];
+      const char * p = first;
+
       for ( int i = 0; i < 4; i ++ )
-        if ( m_Addr[i] != x . m_Addr[i] )
-          return false;
-      return true;
+      {
+        if ( i > 0 )
+        {
+          if ( p == last || *p != '.' )
+            return { first, std::errc::invalid_argument };
+          p ++;
+        }
+        const char * digits = p;
+        unsigned     n = 0;
+        while ( p != last && p - digits < 3 && static_cast<unsigned> ( *p - '0' ) < 10 )
+          n = n * 10 + static_cast<unsigned> ( *p ++ - '0' );
+        if ( p == digits )
+          return { first, std::errc::invalid_argument };
+        if ( n > 255 || ( p != last && static_cast<unsigned> ( *p - '0' ) < 10 ) )
+          return { first, std::errc::result_out_of_range };
+        addr[i] = static_cast<std::uint8_t> ( n );
+      }
+
+      for ( int i = 0; i < 4; i ++ )
+        x . m_Addr[i] = addr[i];
+      return { p, std::errc () };
+    }
+    //---------------------------------------------------------------------------------------------
+    // formats the address into [first, last) in the to_chars fashion, at most MAX_CHARS are written
+    std::to_chars_result     ToChars                       ( char            * first,
+                                                             char            * last ) const noexcept
+    {
+      char   buf[MAX_CHARS];
+      char * p = buf;
+
+      for ( int i = 0; i < 4; i ++ )
+      {
+        if ( i > 0 )
+          *p ++ = '.';
+        unsigned n = m_Addr[i];
+        if ( n >= 100 )
+          *p ++ = static_cast<char> ( '0' + n / 100 );
+        if ( n >= 10 )
+          *p ++ = static_cast<char> ( '0' + n / 10 % 10 );
+        *p ++ = static_cast<char> ( '0' + n % 10 );
+      }
+
+      if ( last - first < p - buf )
+        return { last, std::errc::value_too_large };
+      return { std::copy ( buf, p, first ), std::errc () };
     }
     //---------------------------------------------------------------------------------------------
     friend std::ostream    & operator <<                   ( std::ostream    & os,
                                                              const CIPv4     & x )
     {
-      return os << static_cast<uint32_t> ( x . m_Addr[0] ) << '.'
-                << static_cast<uint32_t> ( x . m_Addr[1] ) << '.'
-                << static_cast<uint32_t> ( x . m_Addr[2] ) << '.'
-                << static_cast<uint32_t> ( x . m_Addr[3] );
+      char buf[MAX_CHARS];
+      return os . write ( buf, x . ToChars ( buf, buf + MAX_CHARS ) . ptr - buf );
     }
     //---------------------------------------------------------------------------------------------
     friend std::istream    & operator >>                   ( std::istream    & is,
@@ -90,6 +201,8 @@ class CIPv4
 class CIPv6
 {
   public:
+    // longest textual form, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff"
+    static constexpr int     MAX_CHARS                     = 39;
     //---------------------------------------------------------------------------------------------
                              CIPv6                         ( void )
     {
@@ -99,32 +212,142 @@ class CIPv6
     //---------------------------------------------------------------------------------------------
                              CIPv6                         ( const std::string & src )
     {
-      std::istringstream iss ( src );
-      if ( !( iss >> *this ) || ! iss . eof () )
+      const char * end = src . data () + src . size ();
+      std::from_chars_result res = FromChars ( src . data (), end, *this );
+      if ( res . ec != std::errc () || res . ptr != end )
         throw std::invalid_argument ( src );
     }
     //---------------------------------------------------------------------------------------------
+    // compares both 64 bit halves at once, without a branch per group
     bool                     operator ==                   ( const CIPv6     & x ) const
     {
+      return ( ( High () ^ x . High () ) | ( Low () ^ x . Low () ) ) == 0;
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator !=                   ( const CIPv6     & x ) const
+    {
+      return ! ( *this == x );
+    }
+    //---------------------------------------------------------------------------------------------
+    // total order, the same as the numeric order of the 128 bit addresses
+    bool                     operator <                    ( const CIPv6     & x ) const
+    {
+      std::uint64_t a = High (), b = x . High ();
+      return ( a < b ) | ( ( a == b ) & ( Low () < x . Low () ) );
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator >                    ( const CIPv6     & x ) const
+    {
+      return x < *this;
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator <=                   ( const CIPv6     & x ) const
+    {
+      return ! ( x < *this );
+    }
+    //---------------------------------------------------------------------------------------------
+    bool                     operator >=                   ( const CIPv6     & x ) const
+    {
+      return ! ( *this < x );
+    }
+    //---------------------------------------------------------------------------------------------
+    // the first (most significant) four groups of the address
+    std::uint64_t            High                          ( void ) const
+    {
+      return std::uint64_t ( m_Addr[0] ) << 48 | std::uint64_t ( m_Addr[1] ) << 32
+             | std::uint64_t ( m_Addr[2] ) << 16 | m_Addr[3];
+    }
+    //---------------------------------------------------------------------------------------------
+    // the last four groups of the address
+    std::uint64_t            Low                           ( void ) const
+    {
+      return std::uint64_t ( m_Addr[4] ) << 48 | std::uint64_t ( m_Addr[5] ) << 32
+             | std::uint64_t ( m_Addr[6] ) << 16 | m_Addr[7];
+    }
+    //---------------------------------------------------------------------------------------------
+    std::size_t              Hash                          ( void ) const
+    {
+      return CIPv4::Mix ( High () ^ CIPv4::Mix ( Low () ) );
+    }
+    //---------------------------------------------------------------------------------------------
+    // network order bytes of the address
+    std::array<std::uint8_t, 16> Octets                    ( void ) const
+    {
+      std::array<std::uint8_t, 16> res;
       for ( int i = 0; i < 8; i ++ )
-        if ( m_Addr[i] != x . m_Addr[i] )
-          return false;
-      return true;
+      {
+        res[2 * i]     = static_cast<std::uint8_t> ( m_Addr[i] >> 8 );
+        res[2 * i + 1] = static_cast<std::uint8_t> ( m_Addr[i] );
+      }
+      return res;
     }
     //---------------------------------------------------------------------------------------------
-    friend std::ostream    & operator <<                   ( std::ostream    & os,
-                                                             const CIPv6     & x )
+    // parses eight colon separated hex groups from [first, last), same contract as CIPv4::FromChars
+    static std::from_chars_result FromChars                ( const char      * first,
+                                                             const char      * last,
+                                                             CIPv6           & x ) noexcept
     {
-      std::ios::fmtflags oldFlags = os . flags ();
-      os << std::hex;
+      std::uint16_t addr[8];
+      const char  * p = first;
+
       for ( int i = 0; i < 8; i ++ )
       {
-        if ( i > 0 ) 
-          os << ':';
-        os << x . m_Addr[i];
+        if ( i > 0 )
+        {
+          if ( p == last || *p != ':' )
+            return { first, std::errc::invalid_argument };
+          p ++;
+        }
+        const char * digits = p;
+        unsigned     n = 0;
+        int          d;
+        while ( p != last && p - digits < 4 && ( d = hexDigit ( *p ) ) >= 0 )
+        {
+          n = n * 16 + static_cast<unsigned> ( d );
+          p ++;
+        }
+        if ( p == digits )
+          return { first, std::errc::invalid_argument };
+        if ( p != last && hexDigit ( *p ) >= 0 )
+          return { first, std::errc::result_out_of_range };
+        addr[i] = static_cast<std::uint16_t> ( n );
       }
-      os . flags ( oldFlags );
-      return os;
+
+      for ( int i = 0; i < 8; i ++ )
+        x . m_Addr[i] = addr[i];
+      return { p, std::errc () };
+    }
+    //---------------------------------------------------------------------------------------------
+    // formats the address into [first, last), lowercase hex without leading zeros (as operator <<)
+    std::to_chars_result     ToChars                       ( char            * first,
+                                                             char            * last ) const noexcept
+    {
+      static const char digits[] = "0123456789abcdef";
+      char   buf[MAX_CHARS];
+      char * p = buf;
+
+      for ( int i = 0; i < 8; i ++ )
+      {
+        if ( i > 0 )
+          *p ++ = ':';
+        unsigned n = m_Addr[i];
+        int      shift = 12;
+        while ( shift > 0 && ( n >> shift ) == 0 )
+          shift -= 4;
+        for ( ; shift >= 0; shift -= 4 )
+          *p ++ = digits[( n >> shift ) & 0xf];
+      }
+
+      if ( last - first < p - buf )
+        return { last, std::errc::value_too_large };
+      return { std::copy ( buf, p, first ), std::errc () };
+    }
+    //---------------------------------------------------------------------------------------------
+    friend std::ostream    & operator <<                   ( std::ostream    & os,
+                                                             const CIPv6     & x )
+    {
+      char buf[MAX_CHARS];
+      return os . write ( buf, x . ToChars ( buf, buf + MAX_CHARS ) . ptr - buf );
     }
     //---------------------------------------------------------------------------------------------
     friend std::istream    & operator >>                   ( std::istream    & is,
@@ -166,6 +389,38 @@ class CIPv6
       n = x;
     }
     //---------------------------------------------------------------------------------------------
+    static int               hexDigit                      ( char              c ) noexcept
+    {
+      if ( c >= '0' && c <= '9' )
+        return c - '0';
+      if ( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+      if ( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+      return -1;
+    }
+    //---------------------------------------------------------------------------------------------
     uint16_t                m_Addr[8];
 };
+
+namespace std
+{
+  template <>
+  struct hash<CIPv4>
+  {
+    size_t                   operator ()                   ( const CIPv4     & x ) const noexcept
+    {
+      return x . Hash ();
+    }
+  };
+
+  template <>
+  struct hash<CIPv6>
+  {
+    size_t                   operator ()                   ( const CIPv6     & x ) const noexcept
+    {
+      return x . Hash ();
+    }
+  };
+}
 #endif /* IPADDRESS_H_34805723904562903456203495629034 */